@@ -1,15 +1,30 @@
 #include "as608_driver.h"
+#include <string.h>
 #include "driver/uart.h"
 #include "esp_log.h"
 #include "driver/gpio.h"
+#include "esp_timer.h"
+#include "sysmem.h"
+#include "soak.h"
+#include "sdkconfig.h"
+#if CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
 
 #define TAG "AS608_DRIVER"
 
 #define AS608_UART_NUM UART_NUM_1       // Sử dụng UART1
 #define AS608_TX_PIN GPIO_NUM_17        // Chân TX của ESP32 nối với RX của AS608
 #define AS608_RX_PIN GPIO_NUM_16        // Chân RX của ESP32 nối với TX của AS608
-#define AS608_BAUD_RATE 57600           // Baud rate mặc định của AS608
+#define AS608_BAUD_RATE CONFIG_VANTAY_AS608_BAUD_RATE  // Baud rate đã thỏa thuận với AS608
+#define AS608_DEFAULT_BAUD 57600        // Baud rate mặc định của AS608
+#define AS608_RESPONSE_TIMEOUT_MS 5000  // Thời gian chờ phản hồi của lệnh thường
+#define AS608_PROBE_TIMEOUT_MS 200      // Thời gian chờ phản hồi khi thăm dò / khôi phục
+#define AS608_OFFLINE_FAILURES 2        // Số lần lỗi liên tiếp trước khi coi cảm biến mất kết nối
 #define AS608_UART_BUF_SIZE 1024        // Kích thước buffer UART
+#define AS608_MAX_PACKET 256            // Độ dài dữ liệu tối đa của một gói
+#define AS608_DRAIN_QUIET_MS 100        // Dòng RX im lặng chừng này thì cảm biến đã gửi xong
+#define AS608_DRAIN_MAX_MS 10000        // Giới hạn xả dữ liệu thừa (ảnh 36 KB ở 57600 baud mất ~6,4 s)
 
 // Lệnh "Verify Password"
 static const uint8_t verify_password_cmd[] = {
@@ -57,10 +72,77 @@ static const uint8_t search_fingerprint_cmd[] = {
     0x04,                              // Mã lệnh: Search
     0x01,                              // BufferID: CharBuffer1
     0x00, 0x00,                        // StartPage: bắt đầu từ trang 0
-    0x00, 0xAF,                        // PageNum: 175 trang (toàn bộ cơ sở dữ liệu)
-    0x00, 0xBD                         // Checksum: 0x04 + 0x01 + 0x00 + 0x00 + 0x00 + 0xAF = 0xBC
+    0x00, 0xB0,                        // PageNum: 176 trang (toàn bộ cơ sở dữ liệu, AS608_LIBRARY_SIZE)
+    0x00, 0xBE                         // Checksum: 0x01 + 0x08 + 0x04 + 0x01 + 0x00 + 0x00 + 0x00 + 0xB0
 };
 
+// Lệnh "Read Valid Template Number" (thăm dò nhẹ)
+static const uint8_t template_num_cmd[] = {
+    0xEF, 0x01, 0xFF, 0xFF, 0xFF, 0xFF, 0x01, 0x00, 0x03,
+    0x1D, 0x00, 0x21
+};
+
+// Lệnh "Read System Parameters"
+static const uint8_t read_sys_para_cmd[] = {
+    0xEF, 0x01, 0xFF, 0xFF, 0xFF, 0xFF, 0x01, 0x00, 0x03,
+    0x0F, 0x00, 0x13
+};
+
+// Baud rate thử lần lượt khi khôi phục (sau baud đã thỏa thuận)
+static const uint32_t recovery_bauds[] = { AS608_DEFAULT_BAUD, 115200, 9600, 19200, 38400 };
+
+// Lệnh "Upload Image" (ImageBuffer -> ESP32)
+static const uint8_t up_image_cmd[] = {
+    0xEF, 0x01, 0xFF, 0xFF, 0xFF, 0xFF, 0x01, 0x00, 0x03,
+    0x0A, 0x00, 0x0E
+};
+
+// Lệnh "Empty" (xóa toàn bộ thư viện mẫu)
+static const uint8_t empty_cmd[] = {
+    0xEF, 0x01, 0xFF, 0xFF, 0xFF, 0xFF, 0x01, 0x00, 0x03,
+    0x0D, 0x00, 0x11
+};
+
+#define AS608_NO_FINGER 0x02            // Mã phản hồi GenImg khi không có ngón tay
+#define AS608_FINGER_POLL_MS 50         // Khoảng nghỉ giữa các lần thử GenImg khi chờ ngón tay
+
+static fp_quality_hint_t last_quality_hint = FP_HINT_OK;
+
+// Trạng thái liên kết UART, truy cập khi giữ as608_lock
+static SemaphoreHandle_t as608_lock = NULL;
+static volatile bool sensor_online = false;
+static TaskHandle_t hold_task = NULL;   // Task đang giữ cảm biến qua as608_hold()
+static int consecutive_failures = 0;
+static int64_t last_activity_us = 0;
+static uint32_t current_baud = AS608_BAUD_RATE;
+static int64_t last_capture_us = 0;
+#if CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t pm_lock = NULL;     // Không light sleep khi đang trao đổi qua UART
+#endif
+
+// Giữ cảm biến cho một giao dịch; khi có quản lý nguồn thì không light sleep
+// trong lúc này vì byte UART đến lúc chip ngủ sẽ bị mất
+static bool as608_lock_take(TickType_t wait) {
+    if (xSemaphoreTake(as608_lock, wait) != pdTRUE) {
+        return false;
+    }
+#if CONFIG_PM_ENABLE
+    if (pm_lock != NULL) {
+        esp_pm_lock_acquire(pm_lock);
+    }
+#endif
+    return true;
+}
+
+static void as608_lock_give(void) {
+#if CONFIG_PM_ENABLE
+    if (pm_lock != NULL) {
+        esp_pm_lock_release(pm_lock);
+    }
+#endif
+    xSemaphoreGive(as608_lock);
+}
+
 // Cấu hình UART
 static void uart_init() {
     const uart_config_t uart_config = {
@@ -89,30 +171,90 @@ static bool as608_send_command(const uint8_t *command, size_t length) {
     return true;
 }
 
-// Nhận phản hồi từ cảm biến
-static bool as608_receive_response(uint8_t *response, size_t length) {
-    int read = uart_read_bytes(AS608_UART_NUM, response, length, pdMS_TO_TICKS(5000));
+// Ghi nhận lỗi liên kết; sau vài lần liên tiếp đánh dấu mất kết nối để monitor khôi phục
+static void as608_link_failed(void) {
+    uart_flush_input(AS608_UART_NUM);   // Bỏ dữ liệu thừa để gói sau bắt đầu đúng header
+    if (++consecutive_failures >= AS608_OFFLINE_FAILURES && sensor_online) {
+        sensor_online = false;
+        ESP_LOGE(TAG, "AS608 marked offline");
+    }
+}
+
+// Lệnh thường không nhận được gì sau AS608_RESPONSE_TIMEOUT_MS: thăm dò ngắn ngay để xác nhận,
+// thay vì đợi thêm một lệnh 5 s nữa mới đánh dấu mất kết nối
+static void as608_no_response(uint32_t timeout_ms) {
+    uint8_t response[14];
+    as608_link_failed();
+    if (!sensor_online || timeout_ms <= AS608_PROBE_TIMEOUT_MS) {
+        return;
+    }
+    if (uart_write_bytes(AS608_UART_NUM, (const char *)template_num_cmd, sizeof(template_num_cmd)) == sizeof(template_num_cmd) &&
+        uart_read_bytes(AS608_UART_NUM, response, sizeof(response), pdMS_TO_TICKS(AS608_PROBE_TIMEOUT_MS)) == sizeof(response) &&
+        response[0] == 0xEF && response[1] == 0x01) {
+        consecutive_failures = 0;   // Cảm biến vẫn trả lời, chỉ lệnh vừa rồi bị lỗi
+    } else {
+        ESP_LOGE(TAG, "AS608 did not answer confirmation probe");
+        as608_link_failed();
+    }
+}
+
+// Đọc đúng length byte từ cảm biến
+static bool as608_read_bytes(uint8_t *buffer, size_t length, uint32_t timeout_ms) {
+    int read = uart_read_bytes(AS608_UART_NUM, buffer, length, pdMS_TO_TICKS(timeout_ms));
+    read = soak_filter_uart(buffer, read);
     if (read > 0 && read < length) {
         ESP_LOGE(TAG, "Partial response received: %d/%d bytes", read, length);
+        as608_link_failed();
         return false;
-    } else if (read == 0) {
+    } else if (read <= 0) {
         ESP_LOGE(TAG, "No response received from AS608.");
+        as608_no_response(timeout_ms);
+        return false;
+    }
+    consecutive_failures = 0;
+    last_activity_us = esp_timer_get_time();
+    return true;
+}
+
+// Nhận gói phản hồi, kiểm tra header để phát hiện lệch khung
+static bool as608_receive_timeout(uint8_t *response, size_t length, uint32_t timeout_ms) {
+    if (!as608_read_bytes(response, length, timeout_ms)) {
         return false;
     }
-    //if (read != length) {
-      //  ESP_LOGE(TAG, "Failed to read response from AS608");
-        //return false;
-    //}
+    if (response[0] != 0xEF || response[1] != 0x01) {
+        ESP_LOGE(TAG, "Response out of sync: %02X %02X", response[0], response[1]);
+        as608_link_failed();
+        return false;
+    }
+    // Gói đầy đủ: kiểm tra checksum (PID + độ dài + dữ liệu)
+    if (length > 9) {
+        size_t total = 9 + ((response[7] << 8) | response[8]);
+        bool valid = total >= 11 && total <= length;
+        uint16_t checksum = 0;
+        for (size_t i = 6; valid && i < total - 2; i++) {
+            checksum += response[i];
+        }
+        if (!valid || checksum != ((response[total - 2] << 8) | response[total - 1])) {
+            ESP_LOGE(TAG, "Response checksum mismatch");
+            as608_link_failed();
+            return false;
+        }
+    }
     return true;
 }
 
+// Nhận phản hồi từ cảm biến
+static bool as608_receive_response(uint8_t *response, size_t length) {
+    return as608_receive_timeout(response, length, AS608_RESPONSE_TIMEOUT_MS);
+}
+
 // Xác thực mật khẩu
-static bool send_verify_password() {
+static bool send_verify_password(uint32_t timeout_ms) {
     uint8_t response[12];
     if (!as608_send_command(verify_password_cmd, sizeof(verify_password_cmd))) {
         return false;
     }
-    if (!as608_receive_response(response, sizeof(response))) {
+    if (!as608_receive_timeout(response, sizeof(response), timeout_ms)) {
         return false;
     }
     if (response[9] != 0x00) {
@@ -123,24 +265,53 @@ static bool send_verify_password() {
     return true;
 }
 
-// Tạo ảnh vân tay
-static bool as608_generate_image() {
+// Gửi lệnh chụp ảnh, trả về mã phản hồi hoặc -1 nếu lỗi liên kết
+static int as608_capture(void) {
     uint8_t response[12];
+    last_capture_us = esp_timer_get_time();
     if (!as608_send_command(gen_image_cmd, sizeof(gen_image_cmd))) {
-        return false;
+        return -1;
     }
     //vTaskDelay(pdMS_TO_TICKS(500));
     if (!as608_receive_response(response, sizeof(response))) {
+        return -1;
+    }
+    return response[9];
+}
+
+// Tạo ảnh vân tay
+static bool as608_generate_image() {
+    int code = as608_capture();
+    if (code < 0) {
         return false;
     }
-    if (response[9] != 0x00) {
-        ESP_LOGE(TAG, "Generate image failed: Error code 0x%02X", response[9]);
+    if (code != 0x00) {
+        ESP_LOGE(TAG, "Generate image failed: Error code 0x%02X", code);
         return false;
     }
     ESP_LOGI(TAG, "Generate image successful");
     return true;
 }
 
+// Chờ có ngón tay (ảnh đã được chụp khi trả về true) hoặc chờ nhấc ngón tay ra
+static bool as608_wait_finger(bool present, uint32_t timeout_ms) {
+    int64_t deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    while (1) {
+        int code = as608_capture();
+        if (code < 0) {
+            return false;
+        }
+        if (present ? code == 0x00 : code == AS608_NO_FINGER) {
+            return true;
+        }
+        if (esp_timer_get_time() >= deadline) {
+            ESP_LOGW(TAG, "Timed out waiting for finger %s", present ? "placement" : "removal");
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(AS608_FINGER_POLL_MS));
+    }
+}
+
 // Hàm tạo đặc điểm từ ảnh vân tay
 static bool as608_generate_character(uint8_t buffer_id) {
     uint8_t response[12];
@@ -171,6 +342,104 @@ static bool as608_generate_character(uint8_t buffer_id) {
     return true;
 }
 
+// Nhận chuỗi gói dữ liệu (PID 02, gói cuối PID 08) sau UpImage / UpChar, chuyển từng
+// gói cho sink ngay khi đến. Luôn đọc hết chuỗi để giữ đúng khung dù sink từ chối dữ liệu.
+typedef bool (*as608_data_sink_t)(const uint8_t *data, size_t length, void *ctx);
+
+// Truyền dữ liệu bị lỗi giữa chừng: cảm biến vẫn tiếp tục gửi các gói còn lại, nên một lần
+// uart_flush_input là chưa đủ. Đọc bỏ cho tới khi dòng im lặng, để lệnh sau không nhận nhầm dữ liệu cũ.
+static bool as608_data_failed(void) {
+    uint8_t discard[64];
+    int64_t deadline = esp_timer_get_time() + AS608_DRAIN_MAX_MS * 1000LL;
+    size_t drained = 0;
+    int read;
+
+    while (esp_timer_get_time() < deadline &&
+           (read = uart_read_bytes(AS608_UART_NUM, discard, sizeof(discard), pdMS_TO_TICKS(AS608_DRAIN_QUIET_MS))) > 0) {
+        drained += read;
+    }
+    uart_flush_input(AS608_UART_NUM);
+    if (drained > 0) {
+        ESP_LOGW(TAG, "Discarded %u bytes of aborted data transfer", (unsigned)drained);
+    }
+    return false;
+}
+
+static bool as608_receive_data(as608_data_sink_t sink, void *ctx) {
+    uint8_t header[9];
+    uint8_t payload[AS608_MAX_PACKET + 2];
+    bool sink_ok = true;
+
+    while (1) {
+        // Header: EF 01, địa chỉ (4), PID, độ dài (2)
+        if (!as608_receive_response(header, sizeof(header))) {
+            return as608_data_failed();
+        }
+        uint16_t len = (header[7] << 8) | header[8];
+        if (header[0] != 0xEF || header[1] != 0x01 || len < 2 || len > sizeof(payload)) {
+            ESP_LOGE(TAG, "Invalid data packet header");
+            return as608_data_failed();
+        }
+        if (!as608_read_bytes(payload, len, AS608_RESPONSE_TIMEOUT_MS)) {
+            return as608_data_failed();
+        }
+
+        uint16_t checksum = header[6] + header[7] + header[8];
+        for (int i = 0; i < len - 2; i++) {
+            checksum += payload[i];
+        }
+        if (checksum != ((payload[len - 2] << 8) | payload[len - 1])) {
+            ESP_LOGE(TAG, "Data packet checksum mismatch");
+            return as608_data_failed();
+        }
+
+        if (sink_ok) {
+            sink_ok = sink(payload, len - 2, ctx);
+        }
+        if (header[6] == 0x08) {        // Gói dữ liệu cuối
+            return sink_ok;
+        }
+        if (header[6] != 0x02) {
+            ESP_LOGE(TAG, "Unexpected packet type 0x%02X", header[6]);
+            return as608_data_failed();
+        }
+    }
+}
+
+#if CONFIG_VANTAY_QUALITY_PRECHECK
+static bool quality_sink(const uint8_t *data, size_t length, void *ctx) {
+    fp_quality_feed(ctx, data, length);
+    return true;
+}
+
+// Tải ảnh vừa chụp và đánh giá chất lượng ngay khi từng gói đến, không cần bộ đệm cả ảnh
+static bool as608_check_image_quality(fp_quality_result_t *result) {
+    static fp_quality_t quality;
+    uint8_t response[12];
+
+    if (!as608_send_command(up_image_cmd, sizeof(up_image_cmd))) {
+        return false;
+    }
+    if (!as608_receive_response(response, sizeof(response))) {
+        return false;
+    }
+    if (response[9] != 0x00) {
+        ESP_LOGE(TAG, "Upload image failed: Error code 0x%02X", response[9]);
+        return false;
+    }
+
+    fp_quality_begin(&quality);
+    if (!as608_receive_data(quality_sink, &quality)) {
+        return false;
+    }
+    fp_quality_finish(&quality, result);
+    ESP_LOGI(TAG, "Image quality: coverage %d%%, contrast %d, clarity %d, center (%d, %d) -> %s",
+             result->coverage, result->contrast, result->clarity,
+             result->center_x, result->center_y, fp_quality_hint_str(result->hint));
+    return true;
+}
+#endif
+
 // Tạo template từ ảnh vân tay
 static bool as608_register_model() {
     uint8_t response[12];
@@ -198,14 +467,179 @@ static bool as608_register_model() {
     return false;
 }
 
+// Đặt baud rate của AS608 (SetSysPara, tham số 4 = N, baud = N * 9600)
+static bool as608_set_baud(uint32_t baud) {
+    uint8_t n = baud / 9600;
+    uint8_t cmd[] = {
+        0xEF, 0x01, 0xFF, 0xFF, 0xFF, 0xFF, 0x01, 0x00, 0x05,
+        0x0E, 0x04, n, 0x00, 0x00
+    };
+    uint16_t checksum = 0x01 + 0x05 + 0x0E + 0x04 + n;
+    cmd[12] = (uint8_t)(checksum >> 8);
+    cmd[13] = (uint8_t)(checksum & 0xFF);
+
+    uint8_t response[12];
+    if (!as608_send_command(cmd, sizeof(cmd))) {
+        return false;
+    }
+    if (!as608_receive_timeout(response, sizeof(response), AS608_PROBE_TIMEOUT_MS)) {
+        return false;
+    }
+    return response[9] == 0x00;
+}
+
+// Chuyển baud rate phía ESP32 và bỏ dữ liệu cũ
+static void uart_switch_baud(uint32_t baud) {
+    uart_wait_tx_done(AS608_UART_NUM, pdMS_TO_TICKS(50));
+    uart_set_baudrate(AS608_UART_NUM, baud);
+    uart_flush_input(AS608_UART_NUM);
+    current_baud = baud;
+}
+
+// Đồng bộ lại UART, bắt tay mật khẩu và đưa baud rate về giá trị đã thỏa thuận. Gọi khi giữ as608_lock.
+static bool as608_resync_locked(void) {
+    uint32_t found = 0;
+
+    // Chờ cảm biến gửi xong phần gói còn dở rồi bỏ đi
+    vTaskDelay(pdMS_TO_TICKS(20));
+    uart_flush_input(AS608_UART_NUM);
+
+    if (current_baud != AS608_BAUD_RATE) {
+        uart_switch_baud(AS608_BAUD_RATE);
+    }
+    if (send_verify_password(AS608_PROBE_TIMEOUT_MS)) {
+        found = AS608_BAUD_RATE;
+    }
+    for (int i = 0; found == 0 && i < sizeof(recovery_bauds) / sizeof(recovery_bauds[0]); i++) {
+        if (recovery_bauds[i] == AS608_BAUD_RATE) {
+            continue;
+        }
+        uart_switch_baud(recovery_bauds[i]);
+        if (send_verify_password(AS608_PROBE_TIMEOUT_MS)) {
+            found = recovery_bauds[i];
+        }
+    }
+    if (found == 0) {
+        uart_switch_baud(AS608_BAUD_RATE);
+        return false;
+    }
+
+    // Cảm biến đang ở baud khác: khôi phục baud đã thỏa thuận
+    if (found != AS608_BAUD_RATE) {
+        ESP_LOGW(TAG, "AS608 answered at %lu baud, restoring %d", (unsigned long)found, AS608_BAUD_RATE);
+        if (!as608_set_baud(AS608_BAUD_RATE)) {
+            return false;
+        }
+        uart_switch_baud(AS608_BAUD_RATE);
+        if (!send_verify_password(AS608_PROBE_TIMEOUT_MS)) {
+            return false;
+        }
+    }
+
+    consecutive_failures = 0;
+    sensor_online = true;
+    return true;
+}
+
+// Lấy quyền dùng cảm biến; thất bại ngay nếu cảm biến đang mất kết nối.
+// Task đã giữ cảm biến qua as608_hold() thì dùng luôn, không lấy lại lock.
+static bool as608_acquire(void) {
+    if (!sensor_online) {
+        ESP_LOGW(TAG, "AS608 offline, command skipped");
+        return false;
+    }
+    if (hold_task == xTaskGetCurrentTaskHandle()) {
+        return true;
+    }
+    return as608_lock_take(portMAX_DELAY);
+}
+
+static void as608_release(void) {
+    if (hold_task != xTaskGetCurrentTaskHandle()) {
+        as608_lock_give();
+    }
+}
+
+bool as608_hold(uint32_t wait_ms) {
+    if (!sensor_online) {
+        ESP_LOGW(TAG, "AS608 offline, command skipped");
+        return false;
+    }
+    if (!as608_lock_take(pdMS_TO_TICKS(wait_ms))) {
+        ESP_LOGW(TAG, "AS608 busy for %lu ms, command skipped", (unsigned long)wait_ms);
+        return false;
+    }
+    hold_task = xTaskGetCurrentTaskHandle();
+    return true;
+}
+
+void as608_unhold(void) {
+    hold_task = NULL;
+    as608_lock_give();
+}
+
 // Khởi tạo cảm biến AS608
 bool as608_init() {
-    uart_init();
-    return send_verify_password();
+    if (as608_lock == NULL) {
+        as608_lock = sysmem_mutex_create();
+        if (as608_lock == NULL) {
+            return false;
+        }
+#if CONFIG_PM_ENABLE
+        esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "as608", &pm_lock);
+#endif
+        uart_init();
+    }
+    as608_lock_take(portMAX_DELAY);
+    bool ok = as608_resync_locked();
+    as608_lock_give();
+    return ok;
+}
+
+bool as608_is_online(void) {
+    return sensor_online;
+}
+
+int64_t as608_last_activity_us(void) {
+    return last_activity_us;
+}
+
+int64_t as608_last_capture_us(void) {
+    return last_capture_us;
+}
+
+// Thăm dò nhẹ bằng TempleteNum; bỏ qua nếu cảm biến đang bận
+bool as608_probe(bool *busy) {
+    uint8_t response[14];
+    *busy = false;
+    if (!as608_lock_take(0)) {
+        *busy = true;
+        return true;
+    }
+    // Cảm biến trả lời đúng khung là đủ, mã lỗi trong gói không phải lỗi liên kết
+    bool ok = as608_send_command(template_num_cmd, sizeof(template_num_cmd)) &&
+              as608_receive_timeout(response, sizeof(response), AS608_PROBE_TIMEOUT_MS);
+    as608_lock_give();
+    return ok;
+}
+
+// Khôi phục liên kết với cảm biến, không cần tắt nguồn
+bool as608_recover(void) {
+    uint8_t response[28];
+    as608_lock_take(portMAX_DELAY);
+    bool ok = as608_resync_locked();
+    // Đọc tham số hệ thống để xác nhận cảm biến trả lời đúng khung
+    if (ok && as608_send_command(read_sys_para_cmd, sizeof(read_sys_para_cmd)) &&
+        as608_receive_timeout(response, sizeof(response), AS608_PROBE_TIMEOUT_MS) && response[9] == 0x00) {
+        ESP_LOGI(TAG, "AS608 recovered: %lu baud, packet size code %d, library %d",
+                 (unsigned long)current_baud, response[23], (response[14] << 8) | response[15]);
+    }
+    as608_lock_give();
+    return ok;
 }
 
 // Đăng ký dấu vân tay
-bool as608_enroll_fingerprint(uint16_t storage_position) {
+static bool enroll_fingerprint_locked(uint16_t storage_position, as608_prompt_cb_t prompt) {
     uint8_t store_cmd[] = {
         0xEF, 0x01, 0xFF, 0xFF, 0xFF, 0xFF, 0x01, 0x00, 0x06,
         0x06, 0x02, (uint8_t)(storage_position >> 8), (uint8_t)(storage_position & 0xFF), 0x00, 0x00
@@ -216,39 +650,45 @@ bool as608_enroll_fingerprint(uint16_t storage_position) {
     store_cmd[14] = (uint8_t)(checksum & 0xFF);
 
     uint8_t response[12];
+    uint32_t timeout_ms = CONFIG_VANTAY_ENROLL_TIMEOUT_S * 1000;
 
-    // Yêu cầu người dùng đặt ngón tay lần đầu
-    ESP_LOGI(TAG, "Please place your finger on the sensor.");
-    vTaskDelay(pdMS_TO_TICKS(3000)); // Chờ 3 giây để người dùng đặt ngón tay
+    // Ngón tay của lượt trước còn trên cảm biến: chờ nhấc ra để không chụp nhầm
+    int code = as608_capture();
+    if (code < 0) {
+        return false;
+    }
+    if (code == 0x00) {
+        prompt(AS608_PROMPT_REMOVE);
+        if (!as608_wait_finger(false, timeout_ms)) {
+            return false;
+        }
+    }
 
-    if (!as608_generate_image()) {
+    // Chụp ngay khi ngón tay được đặt lên thay vì chờ cố định
+    prompt(AS608_PROMPT_PLACE);
+    if (!as608_wait_finger(true, timeout_ms)) {
         ESP_LOGE(TAG, "Failed to generate first image.");
         return false;
     }
-
-    //vTaskDelay(pdMS_TO_TICKS(30));
     if (!as608_generate_character(1)) {
-    ESP_LOGE(TAG, "Failed to generate character for first image.");
-    return false;
-}
-
-    // Yêu cầu người dùng nhấc ngón tay
-    ESP_LOGI(TAG, "Please remove your finger.");
-    vTaskDelay(pdMS_TO_TICKS(3000)); // Chờ 3 giây để người dùng nhấc ngón tay
+        ESP_LOGE(TAG, "Failed to generate character for first image.");
+        return false;
+    }
 
-    // Yêu cầu người dùng đặt ngón tay lần hai
-    ESP_LOGI(TAG, "Please place your finger again.");
-    vTaskDelay(pdMS_TO_TICKS(3000)); // Chờ 3 giây để người dùng đặt ngón tay
+    prompt(AS608_PROMPT_REMOVE);
+    if (!as608_wait_finger(false, timeout_ms)) {
+        return false;
+    }
 
-    if (!as608_generate_image()) {
+    prompt(AS608_PROMPT_PLACE_AGAIN);
+    if (!as608_wait_finger(true, timeout_ms)) {
         ESP_LOGE(TAG, "Failed to generate second image.");
         return false;
     }
-    //vTaskDelay(pdMS_TO_TICKS(30));
     if (!as608_generate_character(2)) {
-    ESP_LOGE(TAG, "Failed to generate character for first image.");
-    return false;
-}
+        ESP_LOGE(TAG, "Failed to generate character for second image.");
+        return false;
+    }
     // Tạo template từ ảnh
     if (!as608_register_model()) {
         ESP_LOGE(TAG, "Failed to create fingerprint template.");
@@ -269,17 +709,37 @@ bool as608_enroll_fingerprint(uint16_t storage_position) {
     return true;
 }
 
-bool as608_verify_fingerprint(uint16_t *matched_id, uint16_t *score) {
+static bool verify_fingerprint_locked(uint16_t *matched_id, uint16_t *score, bool finger_present) {
     uint8_t response[16]; // Phản hồi từ module
 
-    // Lấy hình ảnh vân tay
-    ESP_LOGI(TAG, "Place your finger on the sensor.");
-    vTaskDelay(pdMS_TO_TICKS(3000));
+    // Xóa gợi ý của lần trước ngay từ đầu: GenImg lỗi / cảm biến mất kết nối không được hiện lại
+    last_quality_hint = FP_HINT_OK;
+
+    // Lấy hình ảnh vân tay; WAK đã báo có ngón tay thì chụp ngay
+    if (!finger_present) {
+        ESP_LOGI(TAG, "Place your finger on the sensor.");
+        vTaskDelay(pdMS_TO_TICKS(3000));
+    }
     if (!as608_generate_image()) {
         ESP_LOGE(TAG, "Failed to capture fingerprint image.");
         return false;
     }
 
+#if CONFIG_VANTAY_QUALITY_PRECHECK
+    // Ảnh kém thì báo ngay, không tốn thêm GenChar + Search
+    fp_quality_result_t quality;
+    if (!as608_check_image_quality(&quality)) {
+        // Ảnh tải về không trọn vẹn: dừng lần xác thực này thay vì GenChar trên dòng UART chưa sạch
+        ESP_LOGE(TAG, "Image upload failed, aborting verification.");
+        return false;
+    }
+    if (quality.hint != FP_HINT_OK) {
+        last_quality_hint = quality.hint;
+        ESP_LOGW(TAG, "Image rejected: %s", fp_quality_hint_str(quality.hint));
+        return false;
+    }
+#endif
+
     // Tạo đặc điểm từ hình ảnh
     if (!as608_generate_character(1)) {
         ESP_LOGE(TAG, "Failed to generate fingerprint character.");
@@ -311,3 +771,172 @@ bool as608_verify_fingerprint(uint16_t *matched_id, uint16_t *score) {
     ESP_LOGI(TAG, "Fingerprint matched! ID: %d, Score: %d", *matched_id, *score);
     return true;
 }
+
+// Xóa count mẫu vân tay bắt đầu từ storage_position
+static bool delete_fingerprint_locked(uint16_t storage_position, uint16_t count) {
+    uint8_t delete_cmd[] = {
+        0xEF, 0x01, 0xFF, 0xFF, 0xFF, 0xFF, 0x01, 0x00, 0x07,
+        0x0C, (uint8_t)(storage_position >> 8), (uint8_t)(storage_position & 0xFF),
+        (uint8_t)(count >> 8), (uint8_t)(count & 0xFF), 0x00, 0x00
+    };
+
+    uint16_t checksum = 0x01 + 0x07 + 0x0C + (storage_position >> 8) + (storage_position & 0xFF)
+                        + (count >> 8) + (count & 0xFF);
+    delete_cmd[14] = (uint8_t)(checksum >> 8);
+    delete_cmd[15] = (uint8_t)(checksum & 0xFF);
+
+    uint8_t response[12];
+    if (!as608_send_command(delete_cmd, sizeof(delete_cmd))) {
+        return false;
+    }
+    if (!as608_receive_response(response, sizeof(response))) {
+        return false;
+    }
+    if (response[9] != 0x00) {
+        ESP_LOGE(TAG, "Delete template failed: Error code 0x%02X", response[9]);
+        return false;
+    }
+    ESP_LOGI(TAG, "Deleted %d template(s) from position %d", count, storage_position);
+    return true;
+}
+
+fp_quality_hint_t as608_get_quality_hint(void) {
+    return last_quality_hint;
+}
+
+bool as608_enroll_fingerprint(uint16_t storage_position, as608_prompt_cb_t prompt) {
+    if (!as608_acquire()) {
+        return false;
+    }
+    bool ok = enroll_fingerprint_locked(storage_position, prompt);
+    as608_release();
+    return ok;
+}
+
+bool as608_verify_fingerprint(uint16_t *matched_id, uint16_t *score, bool finger_present) {
+    last_quality_hint = FP_HINT_OK;
+    if (!as608_acquire()) {
+        return false;
+    }
+    bool ok = verify_fingerprint_locked(matched_id, score, finger_present);
+    as608_release();
+    return ok;
+}
+
+bool as608_delete_fingerprint(uint16_t storage_position, uint16_t count) {
+    if (!as608_acquire()) {
+        return false;
+    }
+    bool ok = delete_fingerprint_locked(storage_position, count);
+    as608_release();
+    return ok;
+}
+
+// Bảng chỉ mục: 1 bit cho mỗi vị trí, bit 0 của byte 0 là vị trí 0
+static bool read_index_table_locked(uint8_t bitmap[AS608_LIBRARY_SIZE / 8]) {
+    uint8_t cmd[] = {
+        0xEF, 0x01, 0xFF, 0xFF, 0xFF, 0xFF, 0x01, 0x00, 0x04,
+        0x1F, 0x00, 0x00, 0x24      // ReadIndexTable, trang 0 (vị trí 0-255)
+    };
+    uint8_t response[44];
+
+    if (!as608_send_command(cmd, sizeof(cmd)) || !as608_receive_response(response, sizeof(response))) {
+        return false;
+    }
+    if (response[9] != 0x00) {
+        ESP_LOGE(TAG, "Read index table failed: Error code 0x%02X", response[9]);
+        return false;
+    }
+    memcpy(bitmap, &response[10], AS608_LIBRARY_SIZE / 8);
+    return true;
+}
+
+bool as608_read_index_table(uint8_t bitmap[AS608_LIBRARY_SIZE / 8]) {
+    if (!as608_acquire()) {
+        return false;
+    }
+    bool ok = read_index_table_locked(bitmap);
+    as608_release();
+    return ok;
+}
+
+bool as608_empty_library(void) {
+    uint8_t response[12];
+    if (!as608_acquire()) {
+        return false;
+    }
+    bool ok = as608_send_command(empty_cmd, sizeof(empty_cmd)) &&
+              as608_receive_response(response, sizeof(response));
+    as608_release();
+    if (ok && response[9] != 0x00) {
+        ESP_LOGE(TAG, "Empty library failed: Error code 0x%02X", response[9]);
+        return false;
+    }
+    return ok;
+}
+
+typedef struct {
+    uint8_t *buffer;
+    size_t capacity;
+    size_t length;
+} template_sink_t;
+
+static bool template_sink(const uint8_t *data, size_t length, void *ctx) {
+    template_sink_t *t = ctx;
+    if (t->length + length > t->capacity) {
+        return false;
+    }
+    memcpy(t->buffer + t->length, data, length);
+    t->length += length;
+    return true;
+}
+
+// LoadChar: mẫu trong flash -> CharBuffer1, sau đó UpChar: CharBuffer1 -> ESP32
+static bool upload_template_locked(uint16_t slot, template_sink_t *sink) {
+    uint8_t load_cmd[] = {
+        0xEF, 0x01, 0xFF, 0xFF, 0xFF, 0xFF, 0x01, 0x00, 0x06,
+        0x07, 0x01, (uint8_t)(slot >> 8), (uint8_t)(slot & 0xFF), 0x00, 0x00
+    };
+    uint16_t checksum = 0x01 + 0x06 + 0x07 + 0x01 + (slot >> 8) + (slot & 0xFF);
+    load_cmd[13] = (uint8_t)(checksum >> 8);
+    load_cmd[14] = (uint8_t)(checksum & 0xFF);
+    static const uint8_t up_char_cmd[] = {
+        0xEF, 0x01, 0xFF, 0xFF, 0xFF, 0xFF, 0x01, 0x00, 0x04,
+        0x08, 0x01, 0x00, 0x0E      // UpChar, CharBuffer1
+    };
+    uint8_t response[12];
+
+    if (!as608_send_command(load_cmd, sizeof(load_cmd)) || !as608_receive_response(response, sizeof(response))) {
+        return false;
+    }
+    if (response[9] != 0x00) {
+        ESP_LOGE(TAG, "Load template %d failed: Error code 0x%02X", slot, response[9]);
+        return false;
+    }
+    if (!as608_send_command(up_char_cmd, sizeof(up_char_cmd)) || !as608_receive_response(response, sizeof(response))) {
+        return false;
+    }
+    if (response[9] != 0x00) {
+        ESP_LOGE(TAG, "Upload template %d failed: Error code 0x%02X", slot, response[9]);
+        return false;
+    }
+    if (!as608_receive_data(template_sink, sink)) {
+        ESP_LOGE(TAG, "Template %d larger than %u bytes or corrupted", slot, (unsigned)sink->capacity);
+        return false;
+    }
+    return true;
+}
+
+int as608_upload_template(uint16_t slot, uint8_t *buffer, size_t capacity) {
+    template_sink_t sink = {
+        .buffer = buffer,
+        .capacity = capacity,
+        .length = 0,
+    };
+    if (slot >= AS608_LIBRARY_SIZE || !as608_acquire()) {
+        return -1;
+    }
+    bool ok = upload_template_locked(slot, &sink);
+    as608_release();
+    return ok ? (int)sink.length : -1;
+}
@@ -3,9 +3,46 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include "fp_quality.h"
+
+#define AS608_LIBRARY_SIZE 176      // Số vị trí mẫu vân tay dùng trong thư viện (0-175)
+#define AS608_TEMPLATE_MAX 768      // Đủ cho một mẫu (512 byte) ở mọi kích thước gói
+
+// Lời nhắc trong lúc đăng ký, để lớp giao diện hiển thị lên OLED
+typedef enum {
+    AS608_PROMPT_PLACE,
+    AS608_PROMPT_REMOVE,
+    AS608_PROMPT_PLACE_AGAIN,
+} as608_prompt_t;
+
+typedef void (*as608_prompt_cb_t)(as608_prompt_t prompt);
 
 bool as608_init(void);
-bool as608_enroll_fingerprint(uint16_t storage_position);
-bool as608_verify_fingerprint(uint16_t *matched_id, uint16_t *score);
+// Chụp ngay khi ngón tay được đặt / nhấc, mỗi bước chờ tối đa CONFIG_VANTAY_ENROLL_TIMEOUT_S
+bool as608_enroll_fingerprint(uint16_t storage_position, as608_prompt_cb_t prompt);
+// finger_present: ngón tay đã được WAK báo có sẵn, chụp ảnh ngay không chờ
+bool as608_verify_fingerprint(uint16_t *matched_id, uint16_t *score, bool finger_present);
+bool as608_delete_fingerprint(uint16_t storage_position, uint16_t count);
+bool as608_empty_library(void);
+// Bitmap các vị trí đã có mẫu, bit (slot % 8) của byte slot / 8
+bool as608_read_index_table(uint8_t bitmap[AS608_LIBRARY_SIZE / 8]);
+// Đọc mẫu ở slot vào buffer, trả về số byte hoặc -1
+int as608_upload_template(uint16_t slot, uint8_t *buffer, size_t capacity);
+// Giữ cảm biến cho các lệnh tiếp theo của task gọi, chờ tối đa wait_ms nếu task khác đang
+// dùng (ví dụ đang đăng ký, có thể tới vài chục giây). false nếu bận quá lâu hoặc offline.
+// Các lệnh ở trên gọi trong lúc giữ không chờ lock nữa. Nhả bằng as608_unhold().
+bool as608_hold(uint32_t wait_ms);
+void as608_unhold(void);
+// Gợi ý của lần kiểm tra chất lượng ảnh gần nhất (FP_HINT_OK nếu đạt hoặc không bật)
+fp_quality_hint_t as608_get_quality_hint(void);
+// esp_timer_get_time() lúc gửi lệnh chụp ảnh (GenImg) gần nhất
+int64_t as608_last_capture_us(void);
+
+// Giám sát sức khỏe cảm biến
+bool as608_is_online(void);
+int64_t as608_last_activity_us(void);
+bool as608_probe(bool *busy);
+bool as608_recover(void);
 
 #endif
@@ -0,0 +1,215 @@
+#include "attendance_agg.h"
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "sysmem.h"
+
+#define TAG "ATTENDANCE_AGG"
+
+#define NVS_NAMESPACE   "agg"
+#define NO_MINUTE       0xFFFF
+
+typedef struct {
+    uint16_t first_min;     // NO_MINUTE nếu chưa chấm công trong ngày
+    uint16_t last_min;
+    uint16_t total_min;
+    uint16_t open_min;      // Giờ vào của khoảng đang mở, NO_MINUTE nếu đang ở ngoài
+} agg_entry_t;
+
+typedef struct {
+    uint32_t day;           // YYYYMMDD, 0 = trống
+    agg_entry_t entries[AGG_SLOT_COUNT];
+} agg_day_t;
+
+// Mutex thay vì critical section: sao chép cả bảng (~1,4 KB) không được chặn ngắt
+static SemaphoreHandle_t lock;
+static agg_day_t current_day;
+static agg_day_t closed_day;    // Ngày trước, giữ đến khi gửi thành công
+static bool current_dirty = false;
+static bool closed_dirty = false;
+
+// Bộ đệm dùng ngoài vùng khóa (chỉ time_sync_task gọi checkpoint/snapshot)
+static agg_day_t save_buf;
+static attendance_summary_t snapshot_buf[AGG_SLOT_COUNT];
+
+static void day_reset(agg_day_t *d, uint32_t day) {
+    d->day = day;
+    for (int i = 0; i < AGG_SLOT_COUNT; i++) {
+        d->entries[i].first_min = NO_MINUTE;
+        d->entries[i].last_min = NO_MINUTE;
+        d->entries[i].total_min = 0;
+        d->entries[i].open_min = NO_MINUTE;
+    }
+}
+
+static void local_day_minute(time_t epoch, uint32_t *day, uint16_t *minute) {
+    struct tm timeinfo;
+    localtime_r(&epoch, &timeinfo);
+    *day = (timeinfo.tm_year + 1900) * 10000 + (timeinfo.tm_mon + 1) * 100 + timeinfo.tm_mday;
+    *minute = timeinfo.tm_hour * 60 + timeinfo.tm_min;
+}
+
+static void load_blob(nvs_handle_t nvs, const char *key, agg_day_t *d) {
+    size_t len = sizeof(*d);
+    if (nvs_get_blob(nvs, key, d, &len) != ESP_OK || len != sizeof(*d)) {
+        day_reset(d, 0);
+    }
+}
+
+void agg_init(void) {
+    nvs_handle_t nvs;
+    lock = sysmem_mutex_create();
+    day_reset(&current_day, 0);
+    day_reset(&closed_day, 0);
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return;
+    }
+    load_blob(nvs, "cur", &current_day);
+    load_blob(nvs, "prev", &closed_day);
+    nvs_close(nvs);
+    ESP_LOGI(TAG, "Restored day %lu (closed day %lu pending)",
+             (unsigned long)current_day.day, (unsigned long)closed_day.day);
+}
+
+// Đóng ngày hiện tại khi sang ngày mới. Gọi khi giữ lock.
+static void roll_over_locked(uint32_t day) {
+    if (current_day.day != 0) {
+        if (closed_day.day != 0) {
+            // Ngày đóng trước đó chưa gửi được, bị thay thế
+            ESP_LOGW(TAG, "Dropping unsent summary for %lu", (unsigned long)closed_day.day);
+        }
+        closed_day = current_day;
+        closed_dirty = true;
+    }
+    day_reset(&current_day, day);
+    current_dirty = true;
+}
+
+static void entry_add(agg_entry_t *e, uint16_t minute) {
+    if (e->first_min == NO_MINUTE || minute < e->first_min) {
+        e->first_min = minute;
+    }
+    if (e->last_min == NO_MINUTE || minute > e->last_min) {
+        e->last_min = minute;
+    }
+    // Các lượt chấm công xen kẽ vào / ra
+    if (e->open_min == NO_MINUTE) {
+        e->open_min = minute;
+    } else {
+        if (minute > e->open_min) {
+            e->total_min += minute - e->open_min;
+        }
+        e->open_min = NO_MINUTE;
+    }
+}
+
+void agg_add(uint16_t slot, time_t epoch) {
+    uint32_t day;
+    uint16_t minute;
+    if (slot >= AGG_SLOT_COUNT) {
+        return;
+    }
+    local_day_minute(epoch, &day, &minute);
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (day > current_day.day) {
+        roll_over_locked(day);
+    }
+    if (day == current_day.day) {
+        entry_add(&current_day.entries[slot], minute);
+        current_dirty = true;
+    } else if (day == closed_day.day) {
+        entry_add(&closed_day.entries[slot], minute);
+        closed_dirty = true;
+    } else {
+        day = 0;    // Quá cũ
+    }
+    xSemaphoreGive(lock);
+
+    if (day == 0) {
+        ESP_LOGW(TAG, "Punch for slot %d too old to aggregate", slot);
+    }
+}
+
+void agg_tick(time_t now) {
+    uint32_t day;
+    uint16_t minute;
+    local_day_minute(now, &day, &minute);
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (current_day.day != 0 && day > current_day.day) {
+        roll_over_locked(day);
+    }
+    xSemaphoreGive(lock);
+}
+
+// Sao chép trong lock, ghi NVS ngoài lock; chỉ ghi blob có thay đổi để đỡ mòn flash
+static void save_day(nvs_handle_t nvs, const char *key, agg_day_t *d, bool *day_dirty) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool changed = *day_dirty;
+    if (changed) {
+        memcpy(&save_buf, d, sizeof(save_buf));
+        *day_dirty = false;
+    }
+    xSemaphoreGive(lock);
+    if (changed) {
+        nvs_set_blob(nvs, key, &save_buf, sizeof(save_buf));
+    }
+}
+
+bool agg_closed_day_unsaved(void) {
+    return closed_dirty;
+}
+
+void agg_checkpoint(void) {
+    nvs_handle_t nvs;
+    if (!current_dirty && !closed_dirty) {
+        return;
+    }
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS");
+        return;
+    }
+    save_day(nvs, "cur", &current_day, &current_dirty);
+    save_day(nvs, "prev", &closed_day, &closed_dirty);
+    nvs_commit(nvs);
+    nvs_close(nvs);
+}
+
+int agg_snapshot(bool closed, uint32_t *day, const attendance_summary_t **entries) {
+    const agg_day_t *d = closed ? &closed_day : &current_day;
+    int count = 0;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    *day = d->day;
+    for (int i = 0; i < AGG_SLOT_COUNT; i++) {
+        const agg_entry_t *e = &d->entries[i];
+        if (e->first_min == NO_MINUTE) {
+            continue;
+        }
+        snapshot_buf[count].slot = i;
+        snapshot_buf[count].first_min = e->first_min;
+        snapshot_buf[count].last_min = e->last_min;
+        snapshot_buf[count].total_min = e->total_min;
+        count++;
+    }
+    xSemaphoreGive(lock);
+
+    *entries = snapshot_buf;
+    return count;
+}
+
+bool agg_has_closed_day(void) {
+    return closed_day.day != 0;
+}
+
+void agg_closed_day_sent(uint32_t day) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    // Ngày đóng có thể đã bị thay thế trong lúc gửi
+    if (closed_day.day == day) {
+        day_reset(&closed_day, 0);
+        closed_dirty = true;
+    }
+    xSemaphoreGive(lock);
+}
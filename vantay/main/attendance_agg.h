@@ -0,0 +1,32 @@
+#ifndef _ATTENDANCE_AGG_H_
+#define _ATTENDANCE_AGG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "uploader.h"
+
+#define AGG_SLOT_COUNT 176      // Vị trí vân tay 0-175
+
+// Tổng hợp chấm công theo ngày trên thiết bị: giờ vào đầu tiên, giờ ra cuối cùng
+// và tổng thời gian có mặt (các cặp vào/ra) của từng vị trí vân tay.
+
+// Khôi phục bảng từ NVS
+void agg_init(void);
+// Cộng một lượt chấm công (thời gian đã đóng dấu)
+void agg_add(uint16_t slot, time_t epoch);
+// Chuyển ngày nếu đã qua nửa đêm; gọi định kỳ
+void agg_tick(time_t now);
+// Lưu bảng vào NVS nếu có thay đổi (chỉ ghi ngày nào thay đổi)
+void agg_checkpoint(void);
+// Ngày vừa đóng hoặc vừa gửi xong chưa được lưu: nên checkpoint ngay, không chờ chu kỳ
+bool agg_closed_day_unsaved(void);
+
+// Lấy bảng cần gửi: ngày đã đóng (nếu chưa gửi) trước, sau đó là ngày hiện tại.
+// Trả về số dòng, entries trỏ vào bộ đệm nội bộ, hợp lệ đến lần gọi sau.
+int agg_snapshot(bool closed_day, uint32_t *day, const attendance_summary_t **entries);
+bool agg_has_closed_day(void);
+// Đánh dấu ngày đã đóng đã được gửi thành công
+void agg_closed_day_sent(uint32_t day);
+
+#endif
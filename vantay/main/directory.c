@@ -0,0 +1,103 @@
+#include "directory.h"
+#include <string.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+
+#define TAG "DIRECTORY"
+
+#define DIRECTORY_PARTITION_SUBTYPE 0x40
+
+static const directory_header_t *header = NULL;
+static const uint16_t *slot_map = NULL;
+static const directory_employee_t *employees = NULL;
+
+bool directory_init(void) {
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                           DIRECTORY_PARTITION_SUBTYPE, "directory");
+    if (part == NULL) {
+        ESP_LOGW(TAG, "No directory partition");
+        return false;
+    }
+
+    // Ánh xạ cả phân vùng một lần, không sao chép vào RAM
+    const void *map;
+    esp_partition_mmap_handle_t handle;
+    if (esp_partition_mmap(part, 0, part->size, ESP_PARTITION_MMAP_DATA, &map, &handle) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to mmap directory partition");
+        return false;
+    }
+
+    const directory_header_t *h = map;
+    if (memcmp(h->magic, DIRECTORY_MAGIC, 4) != 0 || h->version != DIRECTORY_VERSION ||
+        h->record_size != sizeof(directory_employee_t) || h->total_size > part->size ||
+        h->total_size < sizeof(*h)) {
+        ESP_LOGW(TAG, "Directory partition empty or invalid");
+        esp_partition_munmap(handle);
+        return false;
+    }
+
+    size_t map_bytes = (h->slot_count * sizeof(uint16_t) + 3) & ~3u;
+    size_t expected = sizeof(*h) + map_bytes + (size_t)h->employee_count * sizeof(directory_employee_t);
+    const uint8_t *data = (const uint8_t *)map + sizeof(*h);
+    if (expected != h->total_size ||
+        esp_rom_crc32_le(0, data, h->total_size - sizeof(*h)) != h->data_crc) {
+        ESP_LOGE(TAG, "Directory CRC/size mismatch");
+        esp_partition_munmap(handle);
+        return false;
+    }
+
+    slot_map = (const uint16_t *)data;
+    employees = (const directory_employee_t *)(data + map_bytes);
+    header = h;
+    ESP_LOGI(TAG, "Directory: %d employee(s), %d slot(s)", h->employee_count, h->slot_count);
+    return true;
+}
+
+const directory_employee_t *directory_lookup(uint16_t slot) {
+    if (header == NULL || slot >= header->slot_count) {
+        return NULL;
+    }
+    uint16_t index = slot_map[slot];
+    if (index == DIRECTORY_NO_EMPLOYEE || index >= header->employee_count) {
+        return NULL;
+    }
+    return &employees[index];
+}
+
+const directory_employee_t *directory_find_code(const char *code) {
+    // Trường code không có '\0' khi mã dài đúng DIRECTORY_CODE_LEN: mã dài hơn sẽ khớp với
+    // tiền tố của nó nên bị từ chối. Mã không dài hơn thì strncmp so sánh cả '\0' cuối mã.
+    if (header == NULL || strnlen(code, DIRECTORY_CODE_LEN + 1) > DIRECTORY_CODE_LEN) {
+        return NULL;
+    }
+    int lo = 0;
+    int hi = header->employee_count - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        int cmp = strncmp(code, employees[mid].code, DIRECTORY_CODE_LEN);
+        if (cmp == 0) {
+            return &employees[mid];
+        }
+        if (cmp < 0) {
+            hi = mid - 1;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return NULL;
+}
+
+int directory_slots(const directory_employee_t *employee, uint16_t *slots, int max) {
+    if (header == NULL || employee == NULL) {
+        return 0;
+    }
+    uint16_t index = employee - employees;
+    int count = 0;
+    for (uint16_t slot = 0; slot < header->slot_count && count < max; slot++) {
+        if (slot_map[slot] == index) {
+            slots[count++] = slot;
+        }
+    }
+    return count;
+}
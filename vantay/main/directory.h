@@ -0,0 +1,47 @@
+#ifndef _DIRECTORY_H_
+#define _DIRECTORY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Danh bạ nhân viên chỉ đọc trong phân vùng "directory", tạo bởi tools/mkdirectory.py.
+// Bố cục (little-endian):
+//   directory_header_t
+//   uint16_t slot_map[slot_count]      vị trí vân tay -> chỉ số nhân viên (0xFFFF = không có)
+//   (đệm tới bội số 4)
+//   directory_employee_t employees[employee_count]   sắp xếp theo code
+#define DIRECTORY_MAGIC         "VDIR"
+#define DIRECTORY_VERSION       1
+#define DIRECTORY_NO_EMPLOYEE   0xFFFF
+#define DIRECTORY_CODE_LEN      12
+#define DIRECTORY_NAME_LEN      20
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t slot_count;
+    uint16_t employee_count;
+    uint16_t record_size;       // sizeof(directory_employee_t)
+    uint32_t data_crc;          // CRC32 của phần sau header
+    uint32_t total_size;        // Header + dữ liệu
+    uint8_t reserved[12];
+} directory_header_t;
+
+typedef struct {
+    char code[DIRECTORY_CODE_LEN];  // Mã nhân viên, kết thúc bằng '\0' nếu ngắn hơn
+    char name[DIRECTORY_NAME_LEN];  // Tên hiển thị trên OLED (chữ in hoa không dấu), luôn kết thúc bằng '\0'
+} directory_employee_t;
+
+// Ánh xạ phân vùng vào bộ nhớ và kiểm tra header/CRC
+bool directory_init(void);
+
+// Nhân viên của một vị trí vân tay, O(1), trỏ thẳng vào flash. NULL nếu không có.
+const directory_employee_t *directory_lookup(uint16_t slot);
+
+// Tìm theo mã nhân viên, khớp đúng toàn bộ mã (tìm kiếm nhị phân)
+const directory_employee_t *directory_find_code(const char *code);
+
+// Các vị trí vân tay được gán cho nhân viên, trả về số vị trí ghi vào slots
+int directory_slots(const directory_employee_t *employee, uint16_t *slots, int max);
+
+#endif
@@ -0,0 +1,161 @@
+#include "fp_quality.h"
+#include <string.h>
+#include <stdlib.h>
+
+// Ngưỡng đánh giá, tinh chỉnh bằng tools/fp_quality_bench.c trên ảnh đã ghi lại
+#define VAR_THRESHOLD       2       // Phương sai tối thiểu của khối có vân (mức xám^2)
+#define MIN_FINGER_COVERAGE 10      // Dưới mức này coi như không có ngón tay (%)
+#define MIN_COVERAGE        45      // %
+#define MIN_CONTRAST        5       // Mức xám 4 bit
+#define MIN_CLARITY         24      // Gradient trung bình x16
+#define MAX_CENTER_OFFSET   3       // Khối
+
+#define BLOCK_PIXELS (FP_BLOCK_SIZE * FP_BLOCK_SIZE)
+#define BLOCK_BYTES  (FP_BLOCK_SIZE / 2)
+
+static inline uint32_t absdiff(int a, int b) {
+    return (uint32_t)(a > b ? a - b : b - a);
+}
+
+void fp_quality_begin(fp_quality_t *q) {
+    memset(q, 0, sizeof(*q));
+}
+
+// Kết thúc một dải 16 hàng: phân loại từng khối là có vân hay nền
+static void close_band(fp_quality_t *q, int band) {
+    for (int bc = 0; bc < FP_BLOCK_COLS; bc++) {
+        uint32_t sum = q->block_sum[bc];
+        // n * var * n = n * sum(x^2) - (sum x)^2, không cần phép chia
+        uint32_t spread = BLOCK_PIXELS * q->block_sq[bc] - sum * sum;
+        if (spread > VAR_THRESHOLD * BLOCK_PIXELS * BLOCK_PIXELS) {
+            q->fg_blocks++;
+            q->fg_grad += q->block_grad[bc];
+            q->fg_x_sum += bc;
+            q->fg_y_sum += band;
+        }
+    }
+    memset(q->block_sum, 0, sizeof(q->block_sum));
+    memset(q->block_sq, 0, sizeof(q->block_sq));
+    memset(q->block_grad, 0, sizeof(q->block_grad));
+}
+
+// Xử lý một hàng đã đóng gói (2 điểm/byte), không giải nén ra bộ đệm riêng
+static void process_row(fp_quality_t *q, const uint8_t *row) {
+    const uint8_t *prev = q->prev_row;
+    const int has_prev = q->row > 0;
+    uint32_t *hist = q->histogram;
+
+    for (int bc = 0; bc < FP_BLOCK_COLS; bc++) {
+        const uint8_t *r = row + bc * BLOCK_BYTES;
+        const uint8_t *p = prev + bc * BLOCK_BYTES;
+        uint32_t sum = 0, sq = 0, grad = 0;
+        for (int i = 0; i < BLOCK_BYTES; i++) {
+            int hi = r[i] >> 4;
+            int lo = r[i] & 0x0F;
+            sum += hi + lo;
+            sq += hi * hi + lo * lo;
+            hist[hi]++;
+            hist[lo]++;
+            grad += absdiff(hi, lo);
+            if (bc * BLOCK_BYTES + i + 1 < FP_ROW_BYTES) {
+                grad += absdiff(lo, r[i + 1] >> 4);
+            }
+            if (has_prev) {
+                grad += absdiff(hi, p[i] >> 4) + absdiff(lo, p[i] & 0x0F);
+            }
+        }
+        q->block_sum[bc] += sum;
+        q->block_sq[bc] += sq;
+        q->block_grad[bc] += grad;
+    }
+
+    memcpy(q->prev_row, row, FP_ROW_BYTES);
+    q->row++;
+    if (q->row % FP_BLOCK_SIZE == 0) {
+        close_band(q, q->row / FP_BLOCK_SIZE - 1);
+    }
+}
+
+void fp_quality_feed(fp_quality_t *q, const uint8_t *data, size_t length) {
+    while (length > 0 && q->row < FP_IMAGE_HEIGHT) {
+        // Gói trùng ranh giới hàng thì xử lý trực tiếp, không sao chép
+        if (q->row_fill == 0 && length >= FP_ROW_BYTES) {
+            process_row(q, data);
+            data += FP_ROW_BYTES;
+            length -= FP_ROW_BYTES;
+            continue;
+        }
+        size_t n = FP_ROW_BYTES - q->row_fill;
+        if (n > length) {
+            n = length;
+        }
+        memcpy(&q->row_buf[q->row_fill], data, n);
+        q->row_fill += n;
+        data += n;
+        length -= n;
+        if (q->row_fill == FP_ROW_BYTES) {
+            q->row_fill = 0;
+            process_row(q, q->row_buf);
+        }
+    }
+}
+
+// Mức xám tại phân vị permille (0-1000) của histogram
+static int histogram_percentile(const uint32_t *hist, uint32_t total, uint32_t permille) {
+    uint32_t target = total * permille / 1000;
+    uint32_t acc = 0;
+    for (int level = 0; level < 16; level++) {
+        acc += hist[level];
+        if (acc > target) {
+            return level;
+        }
+    }
+    return 15;
+}
+
+void fp_quality_finish(const fp_quality_t *q, fp_quality_result_t *result) {
+    const uint32_t total_blocks = FP_BLOCK_COLS * FP_BLOCK_ROWS;
+    uint32_t pixels = 0;
+    for (int i = 0; i < 16; i++) {
+        pixels += q->histogram[i];
+    }
+
+    memset(result, 0, sizeof(*result));
+    result->coverage = (uint8_t)(q->fg_blocks * 100 / total_blocks);
+    if (pixels > 0) {
+        result->contrast = (uint8_t)(histogram_percentile(q->histogram, pixels, 950) -
+                                     histogram_percentile(q->histogram, pixels, 50));
+    }
+    if (q->fg_blocks > 0) {
+        result->clarity = (uint16_t)(q->fg_grad * 16 / (q->fg_blocks * BLOCK_PIXELS));
+        // Nhân 2 để giữ nửa khối khi lấy tâm (FP_BLOCK_COLS - 1) / 2
+        result->center_x = (int8_t)((2 * q->fg_x_sum / (int32_t)q->fg_blocks - (FP_BLOCK_COLS - 1)) / 2);
+        result->center_y = (int8_t)((2 * q->fg_y_sum / (int32_t)q->fg_blocks - (FP_BLOCK_ROWS - 1)) / 2);
+    }
+
+    if (result->coverage < MIN_FINGER_COVERAGE) {
+        result->hint = FP_HINT_NO_FINGER;
+    } else if (result->coverage < MIN_COVERAGE && abs(result->center_y) > MAX_CENTER_OFFSET) {
+        result->hint = result->center_y > 0 ? FP_HINT_MOVE_UP : FP_HINT_MOVE_DOWN;
+    } else if (result->coverage < MIN_COVERAGE && abs(result->center_x) > MAX_CENTER_OFFSET) {
+        result->hint = result->center_x > 0 ? FP_HINT_MOVE_LEFT : FP_HINT_MOVE_RIGHT;
+    } else if (result->coverage < MIN_COVERAGE || result->contrast < MIN_CONTRAST ||
+               result->clarity < MIN_CLARITY) {
+        result->hint = FP_HINT_PRESS_HARDER;
+    } else {
+        result->hint = FP_HINT_OK;
+    }
+}
+
+const char *fp_quality_hint_str(fp_quality_hint_t hint) {
+    switch (hint) {
+    case FP_HINT_OK:           return "OK";
+    case FP_HINT_NO_FINGER:    return "NO FINGER";
+    case FP_HINT_PRESS_HARDER: return "PRESS HARDER";
+    case FP_HINT_MOVE_UP:      return "MOVE UP";
+    case FP_HINT_MOVE_DOWN:    return "MOVE DOWN";
+    case FP_HINT_MOVE_LEFT:    return "MOVE LEFT";
+    case FP_HINT_MOVE_RIGHT:   return "MOVE RIGHT";
+    }
+    return "?";
+}
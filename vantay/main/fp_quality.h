@@ -0,0 +1,57 @@
+#ifndef _FP_QUALITY_H_
+#define _FP_QUALITY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Ảnh AS608: 256 x 288 điểm, 4 bit/điểm, 2 điểm/byte (nibble cao trước)
+#define FP_IMAGE_WIDTH      256
+#define FP_IMAGE_HEIGHT     288
+#define FP_ROW_BYTES        (FP_IMAGE_WIDTH / 2)
+#define FP_BLOCK_SIZE       16
+#define FP_BLOCK_COLS       (FP_IMAGE_WIDTH / FP_BLOCK_SIZE)
+#define FP_BLOCK_ROWS       (FP_IMAGE_HEIGHT / FP_BLOCK_SIZE)
+
+// Gợi ý cho người dùng khi ảnh chưa đạt
+typedef enum {
+    FP_HINT_OK = 0,
+    FP_HINT_NO_FINGER,
+    FP_HINT_PRESS_HARDER,
+    FP_HINT_MOVE_UP,
+    FP_HINT_MOVE_DOWN,
+    FP_HINT_MOVE_LEFT,
+    FP_HINT_MOVE_RIGHT
+} fp_quality_hint_t;
+
+typedef struct {
+    uint8_t coverage;       // % khối 16x16 có vân (0-100)
+    uint8_t contrast;       // Khoảng p5..p95 của mức xám (0-15)
+    uint16_t clarity;       // Gradient trung bình trên vùng có vân (x16)
+    int8_t center_x;        // Lệch tâm vùng vân theo khối (âm = trái)
+    int8_t center_y;        // Lệch tâm vùng vân theo khối (âm = trên)
+    fp_quality_hint_t hint;
+} fp_quality_result_t;
+
+// Trạng thái tính toán tăng dần: chỉ giữ một hàng trước và tổng theo khối của dải hiện tại
+typedef struct {
+    uint8_t row_buf[FP_ROW_BYTES];      // Ghép hàng từ các gói có độ dài bất kỳ
+    uint8_t prev_row[FP_ROW_BYTES];
+    size_t row_fill;
+    int row;
+    uint32_t histogram[16];
+    uint32_t block_sum[FP_BLOCK_COLS];
+    uint32_t block_sq[FP_BLOCK_COLS];
+    uint32_t block_grad[FP_BLOCK_COLS];
+    uint32_t fg_blocks;
+    uint32_t fg_grad;
+    int32_t fg_x_sum;
+    int32_t fg_y_sum;
+} fp_quality_t;
+
+void fp_quality_begin(fp_quality_t *q);
+// Nạp dữ liệu ảnh theo thứ tự nhận từ UpImage, độ dài tùy ý
+void fp_quality_feed(fp_quality_t *q, const uint8_t *data, size_t length);
+void fp_quality_finish(const fp_quality_t *q, fp_quality_result_t *result);
+const char *fp_quality_hint_str(fp_quality_hint_t hint);
+
+#endif
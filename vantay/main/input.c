@@ -0,0 +1,300 @@
+#include "input.h"
+#include "driver/gpio.h"
+#include "esp_timer.h"
+#include "esp_sleep.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#define TAG "INPUT"
+
+// GPIO Definitions
+#define BUTTON_PIN GPIO_NUM_23   // Nút nhấn (kéo lên, nhấn = 0)
+#define TOUCH_PIN GPIO_NUM_19    // Cảm biến chạm (WAK từ AS608, chạm = 1)
+
+#define DEBOUNCE_US       20000     // Thời gian chống dội nút nhấn
+#define LONG_PRESS_US     1500000   // Giữ lâu hơn mức này là nhấn giữ
+#define DOUBLE_WINDOW_US  400000    // Khoảng chờ lần nhấn thứ hai
+
+#if CONFIG_VANTAY_LOW_POWER
+// Ngắt theo mức thay cho ngắt theo cạnh: ESP32 chỉ thức dậy từ light sleep theo mức GPIO.
+// Sau mỗi lần đổi trạng thái, chân được đặt chờ mức ngược lại nên không bỏ sót cạnh nào.
+// Việc đổi mức/đánh thức không làm trong ISR mà trong callback esp_timer.
+#define BUTTON_INTR_TYPE  GPIO_INTR_LOW_LEVEL
+#define TOUCH_INTR_TYPE   GPIO_INTR_HIGH_LEVEL
+#else
+#define BUTTON_INTR_TYPE  GPIO_INTR_ANYEDGE     // Cả hai cạnh để đo thời gian giữ
+#define TOUCH_INTR_TYPE   GPIO_INTR_POSEDGE     // Cạnh lên khi đặt ngón tay
+#endif
+
+typedef enum {
+    TIMER_IDLE,
+    TIMER_DEBOUNCE,     // Đang chờ tín hiệu nút ổn định
+    TIMER_WINDOW        // Đang chờ lần nhấn thứ hai
+} timer_mode_t;
+
+static TaskHandle_t owner_task = NULL;
+// esp_timer thay vì GPTimer: GPTimer giữ khóa APB suốt khi được bật, chặn light sleep
+static esp_timer_handle_t debounce_timer = NULL;
+
+// timer_mode và timer_due_us dùng chung giữa ISR nút và callback, đọc/ghi khi giữ timer_lock
+static portMUX_TYPE timer_lock = portMUX_INITIALIZER_UNLOCKED;
+static timer_mode_t timer_mode = TIMER_IDLE;
+static int64_t timer_due_us = 0;        // Lúc hẹn của lần timer_arm() gần nhất
+
+// Các biến dưới đây chỉ được truy cập trong callback của debounce_timer
+static bool button_down = false;
+static bool short_pending = false;      // Đã có một lần nhấn ngắn, chờ xem có nhấn đúp
+static bool suppress_release = false;   // Bỏ qua lần nhả sau nhấn đúp
+static int64_t press_time_us = 0;
+static int64_t window_deadline_us = 0;
+static volatile int64_t touch_time_us = 0;
+#if CONFIG_VANTAY_LOW_POWER
+// Trạng thái chạm dùng chung giữa ISR, touch_timer_cb và task (rearm/disarm), giữ touch_lock
+static portMUX_TYPE touch_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t touch_timer = NULL;       // Đổi mức ngắt chạm ngoài ISR
+static bool touch_wait_release = false;             // Chờ nhấc ngón tay trước khi nhận lần chạm mới
+static bool touch_released = false;                 // ISR vừa thấy ngón tay nhấc ra
+static bool touch_deferred = false;                 // ISR đã hoãn việc cho touch_timer_cb
+#endif
+
+// Hẹn lại timer cho mode; gọi từ ISR hoặc callback
+static void IRAM_ATTR timer_arm(timer_mode_t mode, uint64_t delay_us) {
+    portENTER_CRITICAL_SAFE(&timer_lock);
+    esp_timer_stop(debounce_timer);
+    timer_mode = mode;
+    timer_due_us = esp_timer_get_time() + delay_us;
+    esp_timer_start_once(debounce_timer, delay_us);
+    portEXIT_CRITICAL_SAFE(&timer_lock);
+}
+
+#if CONFIG_VANTAY_LOW_POWER
+// Đặt mức ngắt của chân, cũng là mức đánh thức từ light sleep. Không gọi trong ISR.
+static void pin_wait_level(gpio_num_t pin, gpio_int_type_t level) {
+    gpio_wakeup_enable(pin, level);
+}
+#endif
+
+// Tắt ngắt cảm biến chạm. Gọi từ task; khi bật light sleep, tắt cả đánh thức để ngón tay
+// còn đặt trên cảm biến trong lúc xử lý không đánh thức chip liên tục
+static void touch_disable(void) {
+#if CONFIG_VANTAY_LOW_POWER
+    portENTER_CRITICAL(&touch_lock);
+    // Bỏ việc ISR còn hoãn, kể cả khi callback đã chạy tới nhưng chưa lấy được lock
+    esp_timer_stop(touch_timer);
+    touch_deferred = false;
+    gpio_intr_disable(TOUCH_PIN);
+    gpio_wakeup_disable(TOUCH_PIN);
+    portEXIT_CRITICAL(&touch_lock);
+#else
+    gpio_intr_disable(TOUCH_PIN);
+#endif
+}
+
+static void notify_owner(uint32_t events) {
+    if (owner_task != NULL) {
+        xTaskNotify(owner_task, events, eSetBits);
+    }
+}
+
+// ISR: nút đổi trạng thái. Tắt ngắt và để timer lấy mẫu lại sau DEBOUNCE_US.
+static void IRAM_ATTR button_isr_handler(void *arg) {
+    gpio_intr_disable(BUTTON_PIN);
+    timer_arm(TIMER_DEBOUNCE, DEBOUNCE_US);
+}
+
+// ISR: ngón tay chạm cảm biến. Báo ngay cho task, ngắt được bật lại bởi input_touch_rearm().
+static void IRAM_ATTR touch_isr_handler(void *arg) {
+    BaseType_t woken = pdFALSE;
+    gpio_intr_disable(TOUCH_PIN);
+#if CONFIG_VANTAY_LOW_POWER
+    // Ngắt mức: đổi mức chờ / tắt đánh thức trong touch_timer_cb, không làm trong ISR
+    bool released;
+    portENTER_CRITICAL_ISR(&touch_lock);
+    released = touch_wait_release;
+    touch_released = released;
+    touch_wait_release = false;
+    touch_deferred = true;
+    esp_timer_start_once(touch_timer, 1);
+    portEXIT_CRITICAL_ISR(&touch_lock);
+    if (released) {
+        return;
+    }
+#endif
+    touch_time_us = esp_timer_get_time();
+    if (owner_task != NULL) {
+        xTaskNotifyFromISR(owner_task, INPUT_EVT_TOUCH, eSetBits, &woken);
+    }
+    if (woken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+// Xử lý trạng thái nút đã ổn định, nhận dạng nhấn ngắn / giữ lâu / nhấn đúp
+static void button_settled(bool down, int64_t now) {
+    if (down == button_down) {
+        return;     // Chỉ là nhiễu, trạng thái không đổi
+    }
+    button_down = down;
+
+    if (down) {
+        press_time_us = now;
+        if (short_pending) {
+            short_pending = false;
+            suppress_release = true;
+            notify_owner(INPUT_EVT_DOUBLE_PRESS);
+        }
+        return;
+    }
+
+    if (suppress_release) {
+        suppress_release = false;
+    } else if (now - press_time_us >= LONG_PRESS_US) {
+        notify_owner(INPUT_EVT_LONG_PRESS);
+    } else {
+        short_pending = true;
+        window_deadline_us = now + DOUBLE_WINDOW_US;
+    }
+}
+
+#if CONFIG_VANTAY_LOW_POWER
+// Phần việc hoãn từ touch_isr_handler, chạy trong task esp_timer
+static void touch_timer_cb(void *arg) {
+    portENTER_CRITICAL(&touch_lock);
+    // Task đã tắt / bật lại cảm biến sau khi ISR hoãn việc: bỏ, không ghi đè cấu hình mới
+    if (touch_deferred) {
+        touch_deferred = false;
+        if (touch_released) {
+            // Ngón tay đã nhấc: chờ lần chạm tiếp theo
+            pin_wait_level(TOUCH_PIN, GPIO_INTR_HIGH_LEVEL);
+            gpio_intr_enable(TOUCH_PIN);
+        } else {
+            // Đang xử lý lần chạm: ngón tay còn đặt không được đánh thức chip liên tục
+            gpio_wakeup_disable(TOUCH_PIN);
+        }
+    }
+    portEXIT_CRITICAL(&touch_lock);
+}
+#endif
+
+// Callback của debounce_timer, chạy trong task esp_timer
+static void timer_cb(void *arg) {
+    int64_t now = esp_timer_get_time();
+    timer_mode_t mode;
+
+    // Lấy và xóa mode trong lock. ISR hẹn lại timer (nhấn nút khi đang chờ cửa sổ nhấn đúp)
+    // ngay trước lúc này thì lần hẹn mới chưa tới hạn: để lần gọi sau xử lý, không ghi đè.
+    portENTER_CRITICAL(&timer_lock);
+    if (now < timer_due_us) {
+        portEXIT_CRITICAL(&timer_lock);
+        return;
+    }
+    mode = timer_mode;
+    timer_mode = TIMER_IDLE;
+    portEXIT_CRITICAL(&timer_lock);
+
+    if (mode == TIMER_DEBOUNCE) {
+        bool down = gpio_get_level(BUTTON_PIN) == 0;
+        button_settled(down, now);
+#if CONFIG_VANTAY_LOW_POWER
+        // Chờ mức ngược lại với trạng thái vừa lấy mẫu
+        pin_wait_level(BUTTON_PIN, down ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL);
+#endif
+        gpio_intr_enable(BUTTON_PIN);
+    } else if (mode == TIMER_WINDOW && short_pending) {
+        short_pending = false;
+        notify_owner(INPUT_EVT_SHORT_PRESS);
+    }
+
+    // Còn chờ lần nhấn thứ hai: hẹn giờ cho phần còn lại của cửa sổ, trừ khi ISR vừa hẹn
+    // chống dội (ngắt nút đã bật lại ở trên); lần chống dội đó sẽ hẹn lại cửa sổ
+    if (short_pending) {
+        int64_t remaining = window_deadline_us - now;
+        uint64_t delay_us = remaining > 0 ? remaining : 1;
+        portENTER_CRITICAL(&timer_lock);
+        if (timer_mode == TIMER_IDLE) {
+            timer_mode = TIMER_WINDOW;
+            timer_due_us = now + delay_us;
+            esp_timer_start_once(debounce_timer, delay_us);
+        }
+        portEXIT_CRITICAL(&timer_lock);
+    }
+}
+
+bool input_init(TaskHandle_t owner) {
+    owner_task = owner;
+
+    // Cấu hình nút nhấn: ngắt cả hai cạnh, hoặc chờ mức thấp (nhấn) rồi đổi mức theo trạng thái nút
+    gpio_config_t button_config = {
+        .pin_bit_mask = (1ULL << BUTTON_PIN),
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .intr_type = BUTTON_INTR_TYPE,
+    };
+    gpio_config(&button_config);
+
+    // Cấu hình cảm biến chạm: cạnh lên / mức cao khi đặt ngón tay
+    gpio_config_t touch_config = {
+        .pin_bit_mask = (1ULL << TOUCH_PIN),
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_DISABLE,
+        .intr_type = TOUCH_INTR_TYPE,
+    };
+    gpio_config(&touch_config);
+
+    // Timer dùng để chống dội và đo cửa sổ nhấn đúp
+    const esp_timer_create_args_t timer_args = {
+        .callback = timer_cb,
+        .name = "input_debounce",
+    };
+    if (esp_timer_create(&timer_args, &debounce_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create debounce timer");
+        return false;
+    }
+
+#if CONFIG_VANTAY_LOW_POWER
+    const esp_timer_create_args_t touch_timer_args = {
+        .callback = touch_timer_cb,
+        .name = "input_touch",
+    };
+    if (esp_timer_create(&touch_timer_args, &touch_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create touch timer");
+        return false;
+    }
+    // Đánh thức từ light sleep theo đúng mức mà ngắt đang chờ
+    pin_wait_level(BUTTON_PIN, GPIO_INTR_LOW_LEVEL);
+    pin_wait_level(TOUCH_PIN, GPIO_INTR_HIGH_LEVEL);
+    esp_sleep_enable_gpio_wakeup();
+#endif
+
+    // Đăng ký ISR
+    gpio_install_isr_service(0);
+    gpio_isr_handler_add(BUTTON_PIN, button_isr_handler, NULL);
+    gpio_isr_handler_add(TOUCH_PIN, touch_isr_handler, NULL);
+
+    ESP_LOGI(TAG, "Input initialized.");
+    return true;
+}
+
+void input_touch_rearm(void) {
+    // Xóa sự kiện chạm cũ để không xác thực lại cùng một lần chạm
+    ulTaskNotifyValueClear(owner_task, INPUT_EVT_TOUCH);
+#if CONFIG_VANTAY_LOW_POWER
+    touch_disable();
+    portENTER_CRITICAL(&touch_lock);
+    // Ngón tay còn đặt trên cảm biến: chờ nhấc ra trước, như ngắt cạnh lên khi không ngủ
+    touch_wait_release = gpio_get_level(TOUCH_PIN) == 1;
+    pin_wait_level(TOUCH_PIN, touch_wait_release ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+    gpio_intr_enable(TOUCH_PIN);
+    portEXIT_CRITICAL(&touch_lock);
+#else
+    gpio_intr_enable(TOUCH_PIN);
+#endif
+}
+
+void input_touch_disarm(void) {
+    touch_disable();
+}
+
+int64_t input_last_touch_us(void) {
+    return touch_time_us;
+}
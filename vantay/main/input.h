@@ -0,0 +1,29 @@
+#ifndef _INPUT_H_
+#define _INPUT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Sự kiện đầu vào, gửi tới task sở hữu qua task notification (eSetBits)
+#define INPUT_EVT_TOUCH         (1UL << 0)  // Ngón tay chạm cảm biến (WAK)
+#define INPUT_EVT_SHORT_PRESS   (1UL << 1)  // Nhấn nút ngắn
+#define INPUT_EVT_LONG_PRESS    (1UL << 2)  // Giữ nút lâu: đăng ký vân tay (admin)
+#define INPUT_EVT_DOUBLE_PRESS  (1UL << 3)  // Nhấn đúp: xóa vân tay
+#define INPUT_EVT_ALL           (INPUT_EVT_TOUCH | INPUT_EVT_SHORT_PRESS | \
+                                 INPUT_EVT_LONG_PRESS | INPUT_EVT_DOUBLE_PRESS)
+
+// Cấu hình GPIO, timer chống dội và ISR. owner là task nhận sự kiện.
+bool input_init(TaskHandle_t owner);
+
+// Bật lại ngắt cảm biến chạm sau khi xử lý xong một lần chạm
+void input_touch_rearm(void);
+
+// Tắt ngắt cảm biến chạm (ví dụ trong lúc đăng ký vân tay)
+void input_touch_disarm(void);
+
+// esp_timer_get_time() lúc ISR nhận lần chạm gần nhất, để đo độ trễ đánh thức -> chụp ảnh
+int64_t input_last_touch_us(void);
+
+#endif
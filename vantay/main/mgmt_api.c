@@ -0,0 +1,576 @@
+#include "mgmt_api.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_http_server.h"
+#include "sdkconfig.h"
+#include "as608_driver.h"
+#include "sysmem.h"
+
+#define TAG "MGMT_API"
+
+#define QUERY_MAX   256     // Độ dài tối đa của query string
+#define LIST_MAX    200     // Độ dài tối đa của một danh sách slot=/code=
+#define SENSOR_WAIT_MS 2000 // Chờ cảm biến tối đa; đang đăng ký (tới vài chục giây) thì trả 503
+
+typedef enum {
+    SESSION_FREE,
+    SESSION_QUEUED,
+    SESSION_RUNNING,
+    SESSION_DONE,
+    SESSION_FAILED,
+    SESSION_CANCELLED,
+} session_status_t;
+
+static const char *const status_names[] = {
+    "free", "queued", "running", "done", "failed", "cancelled",
+};
+
+typedef struct {
+    mgmt_session_t info;
+    session_status_t status;
+} session_t;
+
+// Bảng phiên, truy cập khi giữ session_lock
+static session_t sessions[MGMT_SESSION_MAX];
+static uint32_t next_id = 1;
+static SemaphoreHandle_t session_lock = NULL;
+static TaskHandle_t worker_task = NULL;
+static mgmt_deleted_cb_t deleted_cb = NULL;
+static httpd_handle_t server = NULL;
+
+// Các handler chạy tuần tự trong task của httpd nên dùng chung được bộ đệm tĩnh
+static char query[QUERY_MAX];
+static char list[LIST_MAX];
+static mgmt_session_t requested[MGMT_SESSION_MAX];
+static uint16_t employee_slots[AS608_LIBRARY_SIZE];
+static session_t snapshot[MGMT_SESSION_MAX];
+static uint8_t template_buf[AS608_TEMPLATE_MAX];
+
+static esp_err_t send_error(httpd_req_t *req, const char *status, const char *message) {
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, "text/plain");
+    return httpd_resp_sendstr(req, message);
+}
+
+static esp_err_t send_busy(httpd_req_t *req) {
+    httpd_resp_set_hdr(req, "Retry-After", "5");
+    return send_error(req, "503 Service Unavailable", "Sensor busy or offline");
+}
+
+// So sánh không phụ thuộc vị trí ký tự sai đầu tiên
+static bool token_equal(const char *a, const char *b) {
+    size_t len_a = strlen(a);
+    size_t len_b = strlen(b);
+    uint8_t diff = len_a != len_b;
+    for (size_t i = 0; i < len_a && i < len_b; i++) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
+
+static bool authorized(httpd_req_t *req) {
+    static const char *token = CONFIG_VANTAY_MGMT_API_TOKEN;
+    char header[80];
+    char expected[80];
+
+    if (httpd_req_get_hdr_value_str(req, "Authorization", header, sizeof(header)) != ESP_OK) {
+        return false;
+    }
+    snprintf(expected, sizeof(expected), "Bearer %s", token);
+    return token_equal(header, expected);
+}
+
+// Lấy giá trị của key trong query string vào list; false nếu không có
+static bool query_value(httpd_req_t *req, const char *key) {
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) {
+        return false;
+    }
+    return httpd_query_key_value(query, key, list, sizeof(list)) == ESP_OK;
+}
+
+// Phân tích "3,4,5" trong list thành slot; -1 nếu có giá trị sai
+static int parse_slots(uint16_t *slots, int max) {
+    int count = 0;
+    char *save = NULL;
+    for (char *tok = strtok_r(list, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        char *end;
+        long slot = strtol(tok, &end, 10);
+        if (*end != '\0' || slot < 0 || slot >= AS608_LIBRARY_SIZE || count == max) {
+            return -1;
+        }
+        slots[count++] = (uint16_t)slot;
+    }
+    return count;
+}
+
+// Các slot trong ?slot=, hoặc mọi slot đã có mẫu nếu không có tham số. -1 nếu lỗi.
+static int requested_or_occupied(httpd_req_t *req, uint16_t *slots) {
+    if (query_value(req, "slot")) {
+        return parse_slots(slots, AS608_LIBRARY_SIZE);
+    }
+    uint8_t bitmap[AS608_LIBRARY_SIZE / 8];
+    if (!as608_hold(SENSOR_WAIT_MS)) {
+        return -1;
+    }
+    bool ok = as608_read_index_table(bitmap);
+    as608_unhold();
+    if (!ok) {
+        return -1;
+    }
+    int count = 0;
+    for (uint16_t slot = 0; slot < AS608_LIBRARY_SIZE; slot++) {
+        if (bitmap[slot / 8] & (1 << (slot % 8))) {
+            slots[count++] = slot;
+        }
+    }
+    return count;
+}
+
+// Ô trống, hoặc phiên đã kết thúc lâu nhất; -1 nếu mọi ô đang chờ / đang chạy
+static int session_slot_locked(void) {
+    int oldest = -1;
+    for (int i = 0; i < MGMT_SESSION_MAX; i++) {
+        if (sessions[i].status == SESSION_FREE) {
+            return i;
+        }
+        if (sessions[i].status != SESSION_QUEUED && sessions[i].status != SESSION_RUNNING &&
+            (oldest < 0 || sessions[i].info.id < sessions[oldest].info.id)) {
+            oldest = i;
+        }
+    }
+    return oldest;
+}
+
+// Đọc bảng chỉ mục của cảm biến; false (kết quả gửi lỗi ở *err) nếu cảm biến bận / lỗi
+static bool read_enrolled(httpd_req_t *req, uint8_t bitmap[AS608_LIBRARY_SIZE / 8], esp_err_t *err) {
+    if (!as608_hold(SENSOR_WAIT_MS)) {
+        *err = send_busy(req);
+        return false;
+    }
+    bool ok = as608_read_index_table(bitmap);
+    as608_unhold();
+    if (!ok) {
+        *err = send_error(req, "503 Service Unavailable", "Sensor unavailable");
+    }
+    return ok;
+}
+
+// Slot đã được chọn cho count phiên đầu của request, hoặc đã có phiên đang chờ / đang chạy
+static bool slot_taken_locked(uint16_t slot, int count) {
+    for (int n = 0; n < count; n++) {
+        if (requested[n].slot == slot) {
+            return true;
+        }
+    }
+    for (int i = 0; i < MGMT_SESSION_MAX; i++) {
+        if ((sessions[i].status == SESSION_QUEUED || sessions[i].status == SESSION_RUNNING) &&
+            sessions[i].info.slot == slot) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Slot cho phiên đăng ký theo mã: slot đầu tiên của nhân viên chưa có mẫu và chưa bị phiên
+// khác giữ. Với overwrite, nếu mọi slot đều đã có mẫu thì dùng slot đầu tiên chưa bị giữ.
+// -1 nếu nhân viên không có slot nào trong thư viện, -2 nếu không còn slot dùng được.
+static int pick_code_slot(const directory_employee_t *employee, const uint8_t *bitmap, int count,
+                          bool overwrite) {
+    int mapped = 0;
+    int fallback = -2;
+    int n = directory_slots(employee, employee_slots, AS608_LIBRARY_SIZE);
+
+    xSemaphoreTake(session_lock, portMAX_DELAY);
+    for (int i = 0; i < n; i++) {
+        uint16_t slot = employee_slots[i];
+        if (slot >= AS608_LIBRARY_SIZE) {
+            continue;
+        }
+        mapped++;
+        if (slot_taken_locked(slot, count)) {
+            continue;
+        }
+        if (!(bitmap[slot / 8] & (1 << (slot % 8)))) {
+            xSemaphoreGive(session_lock);
+            return slot;
+        }
+        if (overwrite && fallback < 0) {
+            fallback = slot;
+        }
+    }
+    xSemaphoreGive(session_lock);
+    return mapped == 0 ? -1 : fallback;
+}
+
+// Kiểm tra slot trước khi xếp hàng: false (kết quả gửi lỗi ở *err) nếu một slot bị yêu cầu
+// hai lần, hoặc đã có mẫu trong thư viện (bitmap) mà không có overwrite
+static bool check_enroll_slots(httpd_req_t *req, int count, bool overwrite, const uint8_t *bitmap,
+                               esp_err_t *err) {
+    char message[64];
+
+    for (int n = 0; n < count; n++) {
+        for (int m = 0; m < n; m++) {
+            if (requested[m].slot == requested[n].slot) {
+                snprintf(message, sizeof(message), "Slot %d requested twice", requested[n].slot);
+                *err = send_error(req, "409 Conflict", message);
+                return false;
+            }
+        }
+    }
+    if (overwrite) {
+        return true;
+    }
+    for (int n = 0; n < count; n++) {
+        uint16_t slot = requested[n].slot;
+        if (bitmap[slot / 8] & (1 << (slot % 8))) {
+            snprintf(message, sizeof(message), "Slot %d already enrolled, add overwrite=1", slot);
+            *err = send_error(req, "409 Conflict", message);
+            return false;
+        }
+    }
+    return true;
+}
+
+static esp_err_t enroll_post_handler(httpd_req_t *req) {
+    uint16_t slots[MGMT_SESSION_MAX];
+    uint8_t bitmap[AS608_LIBRARY_SIZE / 8];
+    bool have_bitmap = false;
+    char item[96];
+    int count = 0;
+    esp_err_t err;
+
+    if (!authorized(req)) {
+        return send_error(req, "401 Unauthorized", "Unauthorized");
+    }
+    bool overwrite = query_value(req, "overwrite") && strcmp(list, "1") == 0;
+    if (query_value(req, "slot")) {
+        int n = parse_slots(slots, MGMT_SESSION_MAX);
+        if (n < 0) {
+            return send_error(req, "400 Bad Request", "Invalid slot list");
+        }
+        for (int i = 0; i < n; i++) {
+            requested[count].slot = slots[i];
+            requested[count].code[0] = '\0';
+            count++;
+        }
+    } else if (query_value(req, "code")) {
+        // Chọn slot theo bảng chỉ mục: một nhân viên có thể có nhiều ngón tay
+        char *save = NULL;
+        if (!read_enrolled(req, bitmap, &err)) {
+            return err;
+        }
+        have_bitmap = true;
+        for (char *tok = strtok_r(list, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+            const directory_employee_t *employee = directory_find_code(tok);
+            if (count == MGMT_SESSION_MAX) {
+                return send_error(req, "400 Bad Request", "Too many sessions");
+            }
+            int slot = employee != NULL ? pick_code_slot(employee, bitmap, count, overwrite) : -1;
+            if (slot == -1) {
+                return send_error(req, "404 Not Found", "Employee code not in directory or has no slot");
+            }
+            if (slot < 0) {
+                char message[64];
+                snprintf(message, sizeof(message), "No free slot for %.*s%s", DIRECTORY_CODE_LEN, tok,
+                         overwrite ? "" : ", add overwrite=1");
+                return send_error(req, "409 Conflict", message);
+            }
+            requested[count].slot = (uint16_t)slot;
+            strlcpy(requested[count].code, tok, sizeof(requested[count].code));
+            count++;
+        }
+    }
+    if (count == 0) {
+        return send_error(req, "400 Bad Request", "slot or code required");
+    }
+    if (!overwrite && !have_bitmap && !read_enrolled(req, bitmap, &err)) {
+        return err;
+    }
+    if (!check_enroll_slots(req, count, overwrite, bitmap, &err)) {
+        return err;
+    }
+
+    // Dùng lại các ô trống hoặc đã xong lâu nhất; không xếp hàng gì nếu không đủ chỗ
+    // hoặc slot đã có phiên đang chờ / đang chạy
+    xSemaphoreTake(session_lock, portMAX_DELAY);
+    int available = 0;
+    for (int i = 0; i < MGMT_SESSION_MAX; i++) {
+        if (sessions[i].status != SESSION_QUEUED && sessions[i].status != SESSION_RUNNING) {
+            available++;
+            continue;
+        }
+        for (int n = 0; n < count; n++) {
+            if (sessions[i].info.slot == requested[n].slot) {
+                xSemaphoreGive(session_lock);
+                return send_error(req, "409 Conflict", "Slot already has a pending session");
+            }
+        }
+    }
+    if (available < count) {
+        xSemaphoreGive(session_lock);
+        return send_error(req, "503 Service Unavailable", "Enrollment queue full");
+    }
+    for (int n = 0; n < count; n++) {
+        int i = session_slot_locked();
+        requested[n].id = next_id++;
+        requested[n].overwrite = overwrite;
+        sessions[i].info = requested[n];
+        sessions[i].status = SESSION_QUEUED;
+    }
+    xSemaphoreGive(session_lock);
+    xTaskNotify(worker_task, MGMT_EVT_SESSION, eSetBits);
+    ESP_LOGI(TAG, "Queued %d enrollment session(s)", count);
+
+    httpd_resp_set_status(req, "202 Accepted");
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr_chunk(req, "{\"queued\":[");
+    for (int n = 0; n < count; n++) {
+        snprintf(item, sizeof(item), "%s{\"id\":%lu,\"slot\":%d}", n > 0 ? "," : "",
+                 (unsigned long)requested[n].id, requested[n].slot);
+        httpd_resp_sendstr_chunk(req, item);
+    }
+    httpd_resp_sendstr_chunk(req, "]}");
+    return httpd_resp_sendstr_chunk(req, NULL);
+}
+
+static esp_err_t enroll_get_handler(httpd_req_t *req) {
+    char item[96];
+    bool first = true;
+
+    if (!authorized(req)) {
+        return send_error(req, "401 Unauthorized", "Unauthorized");
+    }
+    xSemaphoreTake(session_lock, portMAX_DELAY);
+    memcpy(snapshot, sessions, sizeof(snapshot));
+    xSemaphoreGive(session_lock);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr_chunk(req, "{\"sessions\":[");
+    for (int i = 0; i < MGMT_SESSION_MAX; i++) {
+        if (snapshot[i].status == SESSION_FREE) {
+            continue;
+        }
+        snprintf(item, sizeof(item), "%s{\"id\":%lu,\"slot\":%d,\"code\":\"%s\",\"status\":\"%s\"}",
+                 first ? "" : ",", (unsigned long)snapshot[i].info.id, snapshot[i].info.slot,
+                 snapshot[i].info.code, status_names[snapshot[i].status]);
+        httpd_resp_sendstr_chunk(req, item);
+        first = false;
+    }
+    httpd_resp_sendstr_chunk(req, "]}");
+    return httpd_resp_sendstr_chunk(req, NULL);
+}
+
+static esp_err_t enroll_delete_handler(httpd_req_t *req) {
+    char body[32];
+    int cancelled = 0;
+
+    if (!authorized(req)) {
+        return send_error(req, "401 Unauthorized", "Unauthorized");
+    }
+    xSemaphoreTake(session_lock, portMAX_DELAY);
+    for (int i = 0; i < MGMT_SESSION_MAX; i++) {
+        if (sessions[i].status == SESSION_QUEUED) {
+            sessions[i].status = SESSION_CANCELLED;
+            cancelled++;
+        }
+    }
+    xSemaphoreGive(session_lock);
+
+    snprintf(body, sizeof(body), "{\"cancelled\":%d}", cancelled);
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_sendstr(req, body);
+}
+
+static esp_err_t templates_get_handler(httpd_req_t *req) {
+    uint8_t bitmap[AS608_LIBRARY_SIZE / 8];
+    char item[16];
+    int count = 0;
+
+    if (!authorized(req)) {
+        return send_error(req, "401 Unauthorized", "Unauthorized");
+    }
+    if (!as608_hold(SENSOR_WAIT_MS)) {
+        return send_busy(req);
+    }
+    bool ok = as608_read_index_table(bitmap);
+    as608_unhold();
+    if (!ok) {
+        return send_error(req, "503 Service Unavailable", "Sensor unavailable");
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    snprintf(item, sizeof(item), "%d", AS608_LIBRARY_SIZE);
+    httpd_resp_sendstr_chunk(req, "{\"capacity\":");
+    httpd_resp_sendstr_chunk(req, item);
+    httpd_resp_sendstr_chunk(req, ",\"slots\":[");
+    for (uint16_t slot = 0; slot < AS608_LIBRARY_SIZE; slot++) {
+        if (bitmap[slot / 8] & (1 << (slot % 8))) {
+            snprintf(item, sizeof(item), "%s%d", count > 0 ? "," : "", slot);
+            httpd_resp_sendstr_chunk(req, item);
+            count++;
+        }
+    }
+    httpd_resp_sendstr_chunk(req, "]}");
+    return httpd_resp_sendstr_chunk(req, NULL);
+}
+
+static esp_err_t templates_delete_handler(httpd_req_t *req) {
+    uint16_t slots[AS608_LIBRARY_SIZE];
+    char body[48];
+    int deleted = 0;
+
+    if (!authorized(req)) {
+        return send_error(req, "401 Unauthorized", "Unauthorized");
+    }
+    if (query_value(req, "all") && strcmp(list, "1") == 0) {
+        if (!as608_hold(SENSOR_WAIT_MS)) {
+            return send_busy(req);
+        }
+        bool ok = as608_empty_library();
+        as608_unhold();
+        if (!ok) {
+            return send_error(req, "503 Service Unavailable", "Failed to empty library");
+        }
+        ESP_LOGW(TAG, "Fingerprint library emptied");
+        deleted_cb(MGMT_ALL_SLOTS);
+        httpd_resp_set_type(req, "application/json");
+        return httpd_resp_sendstr(req, "{\"deleted\":\"all\"}");
+    }
+    if (!query_value(req, "slot")) {
+        return send_error(req, "400 Bad Request", "slot or all=1 required");
+    }
+    int count = parse_slots(slots, AS608_LIBRARY_SIZE);
+    if (count <= 0) {
+        return send_error(req, "400 Bad Request", "Invalid slot list");
+    }
+    if (!as608_hold(SENSOR_WAIT_MS)) {
+        return send_busy(req);
+    }
+    for (int i = 0; i < count; i++) {
+        if (as608_delete_fingerprint(slots[i], 1)) {
+            deleted++;
+            deleted_cb(slots[i]);
+        }
+    }
+    as608_unhold();
+    ESP_LOGI(TAG, "Deleted %d of %d template(s)", deleted, count);
+
+    snprintf(body, sizeof(body), "{\"deleted\":%d,\"failed\":%d}", deleted, count - deleted);
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_sendstr(req, body);
+}
+
+// Gửi từng mẫu ngay khi đọc xong, bộ nhớ dùng không phụ thuộc số mẫu.
+// Giữ cảm biến từng mẫu một để không chặn chấm công suốt cả lần tải.
+static esp_err_t templates_export_handler(httpd_req_t *req) {
+    uint16_t slots[AS608_LIBRARY_SIZE];
+
+    if (!authorized(req)) {
+        return send_error(req, "401 Unauthorized", "Unauthorized");
+    }
+    int count = requested_or_occupied(req, slots);
+    if (count < 0) {
+        return send_error(req, "503 Service Unavailable", "Invalid slot list or sensor unavailable");
+    }
+
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"templates.bin\"");
+    int exported = 0;
+    for (int i = 0; i < count; i++) {
+        if (!as608_hold(SENSOR_WAIT_MS)) {
+            if (exported == 0) {
+                return send_busy(req);
+            }
+            // Đã gửi một phần: cắt kết nối để client thấy luồng chunked bị dở dang
+            ESP_LOGW(TAG, "Export aborted after %d template(s), sensor busy", exported);
+            return ESP_FAIL;
+        }
+        int length = as608_upload_template(slots[i], template_buf, sizeof(template_buf));
+        as608_unhold();
+        if (length < 0) {
+            ESP_LOGW(TAG, "Skipping template %d", slots[i]);
+            continue;
+        }
+        uint8_t record[4] = {
+            (uint8_t)(slots[i] >> 8), (uint8_t)(slots[i] & 0xFF),
+            (uint8_t)(length >> 8), (uint8_t)(length & 0xFF),
+        };
+        if (httpd_resp_send_chunk(req, (const char *)record, sizeof(record)) != ESP_OK ||
+            httpd_resp_send_chunk(req, (const char *)template_buf, length) != ESP_OK) {
+            ESP_LOGW(TAG, "Export aborted by client after %d template(s)", exported);
+            return ESP_FAIL;
+        }
+        exported++;
+    }
+    ESP_LOGI(TAG, "Exported %d of %d template(s)", exported, count);
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+bool mgmt_api_next_session(mgmt_session_t *session) {
+    int next = -1;
+    xSemaphoreTake(session_lock, portMAX_DELAY);
+    for (int i = 0; i < MGMT_SESSION_MAX; i++) {
+        if (sessions[i].status == SESSION_QUEUED &&
+            (next < 0 || sessions[i].info.id < sessions[next].info.id)) {
+            next = i;
+        }
+    }
+    if (next >= 0) {
+        sessions[next].status = SESSION_RUNNING;
+        *session = sessions[next].info;
+    }
+    xSemaphoreGive(session_lock);
+    return next >= 0;
+}
+
+void mgmt_api_session_done(uint32_t id, bool ok) {
+    xSemaphoreTake(session_lock, portMAX_DELAY);
+    for (int i = 0; i < MGMT_SESSION_MAX; i++) {
+        if (sessions[i].info.id == id && sessions[i].status == SESSION_RUNNING) {
+            sessions[i].status = ok ? SESSION_DONE : SESSION_FAILED;
+        }
+    }
+    xSemaphoreGive(session_lock);
+    ESP_LOGI(TAG, "Enrollment session %lu %s", (unsigned long)id, ok ? "done" : "failed");
+}
+
+bool mgmt_api_start(TaskHandle_t worker, mgmt_deleted_cb_t on_deleted) {
+    static const httpd_uri_t handlers[] = {
+        { .uri = "/api/enroll", .method = HTTP_POST, .handler = enroll_post_handler },
+        { .uri = "/api/enroll", .method = HTTP_GET, .handler = enroll_get_handler },
+        { .uri = "/api/enroll", .method = HTTP_DELETE, .handler = enroll_delete_handler },
+        { .uri = "/api/templates", .method = HTTP_GET, .handler = templates_get_handler },
+        { .uri = "/api/templates", .method = HTTP_DELETE, .handler = templates_delete_handler },
+        { .uri = "/api/templates/export", .method = HTTP_GET, .handler = templates_export_handler },
+    };
+
+    // Không có token thì mọi máy trong mạng xóa / tải được cả thư viện: không khởi động
+    if (CONFIG_VANTAY_MGMT_API_TOKEN[0] == '\0') {
+        ESP_LOGE(TAG, "CONFIG_VANTAY_MGMT_API_TOKEN is empty, refusing to start");
+        return false;
+    }
+
+    worker_task = worker;
+    deleted_cb = on_deleted;
+    session_lock = sysmem_mutex_create();
+    if (session_lock == NULL) {
+        return false;
+    }
+
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = CONFIG_VANTAY_MGMT_API_PORT;
+    config.stack_size = CONFIG_VANTAY_MGMT_API_STACK;
+    config.max_uri_handlers = sizeof(handlers) / sizeof(handlers[0]);
+    config.lru_purge_enable = true;
+    if (httpd_start(&server, &config) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start HTTP server");
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(handlers) / sizeof(handlers[0]); i++) {
+        httpd_register_uri_handler(server, &handlers[i]);
+    }
+    ESP_LOGI(TAG, "Management API on port %d", CONFIG_VANTAY_MGMT_API_PORT);
+    return true;
+}
@@ -0,0 +1,52 @@
+#ifndef _MGMT_API_H_
+#define _MGMT_API_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "directory.h"
+
+// API quản lý trong mạng nội bộ (CONFIG_VANTAY_MGMT_API), dùng esp_http_server.
+// Mọi request cần "Authorization: Bearer <CONFIG_VANTAY_MGMT_API_TOKEN>"; token trống thì
+// server không khởi động.
+//
+//   POST   /api/enroll?slot=3,4 | ?code=NV001,NV002   Xếp hàng phiên đăng ký (202); slot đã có
+//          [&overwrite=1]                             mẫu hoặc trùng phiên đang chờ bị từ chối (409)
+//          ?code=: slot đầu tiên của nhân viên chưa có mẫu và chưa có phiên chờ; hết slot trống
+//          thì 409, hoặc ghi đè slot đầu tiên chưa có phiên chờ nếu có overwrite=1
+//   GET    /api/enroll                                Trạng thái các phiên
+//   DELETE /api/enroll                                Hủy các phiên chưa chạy
+//   GET    /api/templates                             Các vị trí đã có mẫu
+//   DELETE /api/templates?slot=3,4 | ?all=1           Xóa mẫu / xóa toàn bộ thư viện
+//   GET    /api/templates/export[?slot=3,4]           Tải mẫu (mặc định: tất cả)
+//
+// Export trả về application/octet-stream, chunked, mỗi mẫu một bản ghi:
+//   uint16 slot (big-endian), uint16 độ dài (big-endian), dữ liệu mẫu
+// Mẫu đọc lỗi bị bỏ qua. Chỉ một mẫu nằm trong RAM tại một thời điểm.
+//
+// Cảm biến đang bận (ví dụ một phiên đăng ký đang chờ ngón tay) quá vài giây thì
+// các endpoint dùng cảm biến trả 503 kèm Retry-After thay vì giữ request.
+
+#define MGMT_EVT_SESSION    (1UL << 8)  // Gửi tới task đăng ký khi có phiên mới, không trùng INPUT_EVT_*
+#define MGMT_SESSION_MAX    64          // Số phiên giữ trong bảng (đang chờ + đã xong gần đây)
+#define MGMT_ALL_SLOTS      0xFFFF      // Báo cho on_deleted: đã xóa toàn bộ thư viện
+
+typedef struct {
+    uint32_t id;
+    uint16_t slot;
+    char code[DIRECTORY_CODE_LEN + 1];  // Mã nhân viên nếu phiên được tạo theo mã, ngược lại rỗng
+    bool overwrite;                     // Cho phép ghi đè mẫu đã có ở slot
+} mgmt_session_t;
+
+// Gọi trong task của httpd sau mỗi mẫu xóa thành công qua DELETE /api/templates
+typedef void (*mgmt_deleted_cb_t)(uint16_t slot);
+
+// Khởi động HTTP server. worker là task chạy các phiên đăng ký. Gọi sau connect_wifi().
+bool mgmt_api_start(TaskHandle_t worker, mgmt_deleted_cb_t on_deleted);
+
+// Dành cho task đăng ký: lấy phiên tiếp theo theo thứ tự xếp hàng, false nếu hết
+bool mgmt_api_next_session(mgmt_session_t *session);
+void mgmt_api_session_done(uint32_t id, bool ok);
+
+#endif
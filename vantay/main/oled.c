@@ -1,11 +1,29 @@
 #include "oled.h"
 #include "driver/i2c.h"
+#include "sysmem.h"
 
 // I2C Configuration
 #define I2C_MASTER_NUM I2C_NUM_0
 #define I2C_MASTER_SCL_IO 22
 #define I2C_MASTER_SDA_IO 21
 #define OLED_ADDR 0x3C
+
+// fingerprint_task và time_sync_task cùng vẽ / bật tắt màn hình: mỗi màn hình (đặt trang,
+// cột rồi gửi dữ liệu) phải đi liền một mạch trên I2C
+static SemaphoreHandle_t oled_lock = NULL;
+
+static void oled_take(void) {
+    if (oled_lock != NULL) {
+        xSemaphoreTake(oled_lock, portMAX_DELAY);
+    }
+}
+
+static void oled_give(void) {
+    if (oled_lock != NULL) {
+        xSemaphoreGive(oled_lock);
+    }
+}
+
 // Cấu hình I2C
 
 // Font 5x8 cho các số từ '0' đến '9' và dấu ':'
@@ -23,6 +41,16 @@ const uint8_t font5x8_digits[11][5] = {
     {0x00, 0x36, 0x36, 0x00, 0x00}  // ':' (Dấu hai chấm)
 };
 const uint8_t font5x8[96][5] = {
+    [16] = {0x3E, 0x51, 0x49, 0x45, 0x3E}, // 5x8'0'
+    [17] = {0x00, 0x42, 0x7F, 0x40, 0x00}, // 5x8'1'
+    [18] = {0x42, 0x61, 0x51, 0x49, 0x46}, // 5x8'2'
+    [19] = {0x21, 0x41, 0x45, 0x4B, 0x31}, // 5x8'3'
+    [20] = {0x18, 0x14, 0x12, 0x7F, 0x10}, // 5x8'4'
+    [21] = {0x27, 0x45, 0x45, 0x45, 0x39}, // 5x8'5'
+    [22] = {0x3C, 0x4A, 0x49, 0x49, 0x30}, // 5x8'6'
+    [23] = {0x01, 0x71, 0x09, 0x05, 0x03}, // 5x8'7'
+    [24] = {0x36, 0x49, 0x49, 0x49, 0x36}, // 5x8'8'
+    [25] = {0x06, 0x49, 0x49, 0x29, 0x1E}, // 5x8'9'
     [33] = {0x7C, 0x12, 0x11, 0x12, 0x7C}, // 5x8'A'
     [34] = {0x7F, 0x49, 0x49, 0x49, 0x36}, // 5x8'B'
     [35] = {0x3E, 0x41, 0x41, 0x41, 0x22}, // 5x8'C'
@@ -82,6 +110,9 @@ void oled_send_data(const uint8_t *data, size_t length) {uint8_t buffer[129];
 
 // Khởi tạo OLEDy6
 void oled_init() {
+    if (oled_lock == NULL) {
+        oled_lock = sysmem_mutex_create();
+    }
     oled_send_command(0xAE); // Display off
     oled_send_command(0xA8); // Set multiplex
     oled_send_command(0x3F); // 64 MUX
@@ -99,9 +130,16 @@ void oled_init() {
     oled_send_command(0xAF); // Display ON
 }
 
+// Bật/tắt màn hình (sleep của SSD1306), nội dung RAM được giữ nguyên
+void oled_set_display(bool on) {
+    oled_take();
+    oled_send_command(on ? 0xAF : 0xAE);
+    oled_give();
+}
+
 // Xóa màn hình OLED
 void oled_clear() {
-    uint8_t buffer[1024] = {0};
+    static const uint8_t buffer[128] = {0};   // Một trang trống, dùng lại cho cả 8 trang
     for (int i = 0; i < 8; i++) {
         oled_send_command(0xB0 + i); // Page address
         oled_send_command(0x00);     // Lower column start
@@ -152,11 +190,14 @@ void oled_draw_time(uint8_t x, uint8_t y, const char *time_str) {
 }
 
 void draw_time(char *time){
+    oled_take();
     oled_clear();   
     oled_draw_time(50, 4, time);
+    oled_give();
 }
 
 void draw_verifying(){
+    oled_take();
     oled_clear();
     //Chuyển sang font 5x8
     int a = 40;
@@ -169,9 +210,11 @@ void draw_verifying(){
     oled_draw_str(a + 36, 2, "I", font5x8, 5);
     oled_draw_str(a + 42, 2, "N", font5x8, 5);
     oled_draw_str(a + 48, 2, "G", font5x8, 5); 
+    oled_give();
 }
 
 void draw_success(){
+    oled_take();
     oled_clear();
     int a = 42;
     oled_draw_str(a, 2, "V", font5x8, 5);
@@ -188,8 +231,10 @@ void draw_success(){
     oled_draw_str(a + 24, 3, "E", font5x8, 5);
     oled_draw_str(a + 30, 3, "S", font5x8, 5);
     oled_draw_str(a + 36, 3, "S", font5x8, 5);
+    oled_give();
 }
 void draw_fail(){
+    oled_take();
     oled_clear();
     int a = 42;
     oled_draw_str(a, 2, "V", font5x8, 5);
@@ -203,4 +248,15 @@ void draw_fail(){
     oled_draw_str(a + 6, 3, "A", font5x8, 5);
     oled_draw_str(a + 12, 3, "I", font5x8, 5);
     oled_draw_str(a + 18, 3, "L", font5x8, 5);
+    oled_give();
+}
+
+// Hiển thị một dòng thông báo (chữ in hoa) ở giữa màn hình
+void draw_message(const char *msg){
+    oled_take();
+    oled_clear();
+    int len = strlen(msg);
+    int a = (128 - len * 6) / 2;
+    oled_draw_str(a < 0 ? 0 : a, 3, msg, font5x8, 5);
+    oled_give();
 }
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 
 // Font Definitions
@@ -11,10 +12,12 @@ extern const uint8_t font5x8_digits[11][5];
 extern const uint8_t font5x8[96][5];
 
 // Function Prototypes
+// oled_set_display và các hàm draw_* giữ khóa OLED, gọi được từ nhiều task (sau oled_init)
 void i2c_master_init();
 void oled_init();
 void oled_send_command(uint8_t cmd);
 void oled_send_data(const uint8_t *data, size_t length);
+void oled_set_display(bool on);
 void oled_clear();
 void oled_draw_digit(uint8_t x, uint8_t y, char digit);
 void oled_draw_char(uint8_t x, uint8_t y, char c, const uint8_t font[][5], uint8_t width);
@@ -24,5 +27,6 @@ void draw_time(char *time);
 void draw_verifying();
 void draw_success();
 void draw_fail();
+void draw_message(const char *msg);
 
 #endif // OLED_DISPLAY_H
@@ -0,0 +1,131 @@
+#include "power.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "sdkconfig.h"
+#include "oled.h"
+#include "sysmem.h"
+#if CONFIG_VANTAY_LOW_POWER
+#include "esp_pm.h"
+#endif
+
+#define TAG "POWER"
+
+#define MIN_CPU_FREQ_MHZ        40          // Tần số thạch anh, thấp nhất khi không có khóa DFS
+#define WAKE_LATENCY_BUDGET_US  50000       // Mục tiêu độ trễ chạm -> chụp ảnh
+
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static volatile int64_t last_activity_us = 0;
+static volatile bool display_on = true;
+// power_activity (fingerprint_task) và power_tick (time_sync_task) cùng bật/tắt màn hình:
+// kiểm tra trạng thái và lệnh I2C phải đi cùng nhau để màn hình không kẹt ở trạng thái tắt
+static SemaphoreHandle_t display_lock = NULL;
+
+// Thống kê độ trễ chạm -> chụp ảnh, tính từ lúc ISR chạy: không gồm thời gian thoát light sleep
+static uint32_t wake_count = 0;
+static uint32_t wake_over_budget = 0;
+static int64_t wake_total_us = 0;
+static int64_t wake_max_us = 0;
+
+bool power_init(void) {
+    last_activity_us = esp_timer_get_time();
+    display_lock = sysmem_mutex_create();
+    if (display_lock == NULL) {
+        ESP_LOGE(TAG, "Failed to create display mutex");
+        return false;
+    }
+#if CONFIG_VANTAY_LOW_POWER
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = MIN_CPU_FREQ_MHZ,
+        .light_sleep_enable = true,
+    };
+    esp_err_t err = esp_pm_configure(&pm_config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to enable light sleep: %s", esp_err_to_name(err));
+        return false;
+    }
+    ESP_LOGI(TAG, "Auto light sleep enabled, CPU %d-%d MHz", MIN_CPU_FREQ_MHZ, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+#endif
+    return true;
+}
+
+void power_wifi_started(void) {
+#if CONFIG_VANTAY_LOW_POWER
+    // Tắt RF giữa các beacon DTIM; kết nối và độ trễ nhận gói vẫn giữ được
+    esp_err_t err = esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to enable Wi-Fi modem sleep: %s", esp_err_to_name(err));
+    }
+#endif
+}
+
+void power_activity(void) {
+    xSemaphoreTake(display_lock, portMAX_DELAY);
+    last_activity_us = esp_timer_get_time();
+    if (!display_on) {
+        display_on = true;
+        oled_set_display(true);
+    }
+    xSemaphoreGive(display_lock);
+}
+
+void power_tick(void) {
+#if CONFIG_VANTAY_LOW_POWER && CONFIG_VANTAY_DISPLAY_OFF_S > 0
+    xSemaphoreTake(display_lock, portMAX_DELAY);
+    if (display_on && esp_timer_get_time() - last_activity_us >= CONFIG_VANTAY_DISPLAY_OFF_S * 1000000LL) {
+        display_on = false;
+        oled_set_display(false);
+    }
+    xSemaphoreGive(display_lock);
+#endif
+}
+
+bool power_display_on(void) {
+    return display_on;
+}
+
+void power_record_wake_latency(int64_t touch_us, int64_t capture_us) {
+    int64_t latency = capture_us - touch_us;
+    if (touch_us <= 0 || latency < 0) {
+        return;
+    }
+    taskENTER_CRITICAL(&lock);
+    wake_count++;
+    wake_total_us += latency;
+    if (latency > wake_max_us) {
+        wake_max_us = latency;
+    }
+    if (latency > WAKE_LATENCY_BUDGET_US) {
+        wake_over_budget++;
+    }
+    taskEXIT_CRITICAL(&lock);
+
+    if (latency > WAKE_LATENCY_BUDGET_US) {
+        ESP_LOGW(TAG, "Touch-to-capture %lld ms, over %d ms budget",
+                 (long long)(latency / 1000), WAKE_LATENCY_BUDGET_US / 1000);
+    } else {
+        ESP_LOGI(TAG, "Touch-to-capture %lld ms", (long long)(latency / 1000));
+    }
+}
+
+void power_report(void) {
+    uint32_t count, over;
+    int64_t total, max;
+
+    taskENTER_CRITICAL(&lock);
+    count = wake_count;
+    over = wake_over_budget;
+    total = wake_total_us;
+    max = wake_max_us;
+    taskEXIT_CRITICAL(&lock);
+
+    ESP_LOGI(TAG, "Touch-to-capture: %lu capture(s), avg %lld ms, max %lld ms, %lu over %d ms",
+             (unsigned long)count, (long long)(count > 0 ? total / count / 1000 : 0),
+             (long long)(max / 1000), (unsigned long)over, WAKE_LATENCY_BUDGET_US / 1000);
+#if CONFIG_VANTAY_LOW_POWER && CONFIG_PM_PROFILING
+    esp_pm_dump_locks(stdout);
+#endif
+}
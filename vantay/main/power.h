@@ -0,0 +1,27 @@
+#ifndef _POWER_H_
+#define _POWER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Quản lý nguồn: light sleep tự động giữa các sự kiện (CONFIG_VANTAY_LOW_POWER),
+// tắt màn hình khi rảnh và đo độ trễ từ lúc chạm đến lúc chụp ảnh.
+
+// Cấu hình DFS + light sleep tự động. Gọi trước khi tạo task.
+bool power_init(void);
+
+// Wi-Fi ở modem sleep, thức theo DTIM. Gọi sau connect_wifi().
+void power_wifi_started(void);
+
+// Có sự kiện đầu vào: bật lại màn hình, đặt lại thời gian rảnh
+void power_activity(void);
+
+// Gọi mỗi giây: tắt màn hình khi rảnh quá lâu
+void power_tick(void);
+bool power_display_on(void);
+
+// Ghi nhận độ trễ từ ngắt chạm đến lúc gửi lệnh chụp ảnh
+void power_record_wake_latency(int64_t touch_us, int64_t capture_us);
+void power_report(void);
+
+#endif
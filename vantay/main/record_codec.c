@@ -0,0 +1,76 @@
+#include "record_codec.h"
+
+static size_t put_varint(uint8_t *p, uint32_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+static uint32_t zigzag(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+bool record_writer_begin(record_writer_t *w, uint8_t *buf, size_t cap, uint32_t device_id,
+                         uint32_t base_epoch, uint32_t base_seq) {
+    w->buf = buf;
+    w->cap = cap;
+    w->len = 0;
+    w->prev_epoch = base_epoch;
+    w->prev_seq = base_seq;
+    w->count = 0;
+    if (cap < 1 + 5 + 5 + 5) {
+        return false;
+    }
+    buf[w->len++] = RECORD_FORMAT_V2;
+    w->len += put_varint(&buf[w->len], device_id);
+    w->len += put_varint(&buf[w->len], base_epoch);
+    w->len += put_varint(&buf[w->len], base_seq);
+    return true;
+}
+
+bool record_writer_add(record_writer_t *w, uint16_t slot, uint32_t seq, uint32_t epoch, uint32_t uncertainty_ms) {
+    if (w->len + RECORD_MAX_BYTES > w->cap) {
+        return false;
+    }
+    // UINT32_MAX (không giới hạn) -> 0 sau khi cộng 1
+    w->len += put_varint(&w->buf[w->len], slot);
+    w->len += put_varint(&w->buf[w->len], zigzag((int32_t)(epoch - w->prev_epoch)));
+    w->len += put_varint(&w->buf[w->len], uncertainty_ms + 1);
+    w->len += put_varint(&w->buf[w->len], zigzag((int32_t)(seq - w->prev_seq)));
+    w->prev_epoch = epoch;
+    w->prev_seq = seq;
+    w->count++;
+    return true;
+}
+
+bool summary_writer_begin(record_writer_t *w, uint8_t *buf, size_t cap, uint32_t device_id, uint32_t day) {
+    w->buf = buf;
+    w->cap = cap;
+    w->len = 0;
+    w->prev_epoch = 0;
+    w->prev_seq = 0;
+    w->count = 0;
+    if (cap < 1 + 5 + 5) {
+        return false;
+    }
+    buf[w->len++] = SUMMARY_FORMAT_V1;
+    w->len += put_varint(&buf[w->len], device_id);
+    w->len += put_varint(&buf[w->len], day);
+    return true;
+}
+
+bool summary_writer_add(record_writer_t *w, uint16_t slot, uint16_t first_min, uint16_t last_min, uint16_t total_min) {
+    if (w->len + SUMMARY_ENTRY_MAX_BYTES > w->cap) {
+        return false;
+    }
+    w->len += put_varint(&w->buf[w->len], slot);
+    w->len += put_varint(&w->buf[w->len], first_min);
+    w->len += put_varint(&w->buf[w->len], last_min);
+    w->len += put_varint(&w->buf[w->len], total_min);
+    w->count++;
+    return true;
+}
@@ -0,0 +1,53 @@
+#ifndef _RECORD_CODEC_H_
+#define _RECORD_CODEC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Định dạng nhị phân cho bản ghi chấm công (giải mã bởi tools/record_receiver.py):
+//   0xA3                       phiên bản
+//   varint device_id
+//   varint base_epoch          giây Unix của bản ghi đầu
+//   varint base_seq            số thứ tự của bản ghi đầu
+//   lặp lại cho từng bản ghi:
+//     varint slot              vị trí vân tay 0-175
+//     zigzag varint delta      epoch - epoch của bản ghi trước (giây)
+//     varint uncertainty+1     sai số (ms), 0 = không giới hạn
+//     zigzag varint seq delta  seq - seq của bản ghi trước
+//
+// Bản 0xA1 cũ (không có seq) chỉ còn được bộ nhận giải mã.
+//
+// Gói tổng hợp theo ngày:
+//   0xA2
+//   varint device_id
+//   varint day                 YYYYMMDD theo giờ địa phương
+//   lặp lại cho từng nhân viên có chấm công:
+//     varint slot, varint first_min, varint last_min, varint total_min   (phút trong ngày)
+#define RECORD_FORMAT_V2 0xA3
+#define SUMMARY_FORMAT_V1 0xA2
+
+// Kích thước tối đa của một bản ghi sau mã hóa
+#define RECORD_MAX_BYTES (3 + 5 + 5 + 5)
+#define SUMMARY_ENTRY_MAX_BYTES (3 + 2 + 2 + 2)
+
+typedef struct {
+    uint8_t *buf;
+    size_t cap;
+    size_t len;
+    uint32_t prev_epoch;
+    uint32_t prev_seq;
+    uint16_t count;
+} record_writer_t;
+
+// Bắt đầu một gói trong bộ đệm có sẵn (dùng lại giữa các lần gửi)
+bool record_writer_begin(record_writer_t *w, uint8_t *buf, size_t cap, uint32_t device_id,
+                         uint32_t base_epoch, uint32_t base_seq);
+// Thêm một bản ghi, trả về false nếu bộ đệm không đủ chỗ
+bool record_writer_add(record_writer_t *w, uint16_t slot, uint32_t seq, uint32_t epoch, uint32_t uncertainty_ms);
+
+// Gói tổng hợp theo ngày, dùng cùng record_writer_t
+bool summary_writer_begin(record_writer_t *w, uint8_t *buf, size_t cap, uint32_t device_id, uint32_t day);
+bool summary_writer_add(record_writer_t *w, uint16_t slot, uint16_t first_min, uint16_t last_min, uint16_t total_min);
+
+#endif
@@ -0,0 +1,112 @@
+#include "sensor_health.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "as608_driver.h"
+#include "sysmem.h"
+#include "sdkconfig.h"
+
+#define TAG "SENSOR_HEALTH"
+
+#if CONFIG_VANTAY_LOW_POWER
+#define HEALTH_TICK_MS          1000        // Thức ít hơn để chip ngủ được lâu hơn
+#else
+#define HEALTH_TICK_MS          100         // Chu kỳ kiểm tra của task giám sát
+#endif
+#define RECOVERY_BACKOFF_MAX_MS 10000       // Khoảng thử lại tối đa khi cảm biến không trả lời
+#define HEALTH_LOG_INTERVAL_US  (10 * 60 * 1000000LL)
+
+// Mọi trường của health chỉ được ghi trong lock, sensor_health_get() đọc bản sao nhất quán
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static sensor_health_t health;
+static int64_t online_us = 0;
+static int64_t offline_us = 0;
+
+static void account(bool online, int64_t elapsed_us) {
+    taskENTER_CRITICAL(&lock);
+    if (online) {
+        online_us += elapsed_us;
+    } else {
+        offline_us += elapsed_us;
+    }
+    health.online = online;
+    int64_t total = online_us + offline_us;
+    health.availability_permille = total > 0 ? (uint32_t)(online_us * 1000 / total) : 1000;
+    taskEXIT_CRITICAL(&lock);
+}
+
+static void log_health(void) {
+    sensor_health_t h;
+    sensor_health_get(&h);
+    ESP_LOGI(TAG, "AS608 %s, availability %lu.%lu%%, probes %lu (%lu failed), recoveries %lu/%lu, last %lu ms",
+             h.online ? "online" : "offline",
+             (unsigned long)(h.availability_permille / 10), (unsigned long)(h.availability_permille % 10),
+             (unsigned long)h.probes, (unsigned long)h.probe_failures,
+             (unsigned long)h.recoveries, (unsigned long)h.recovery_attempts,
+             (unsigned long)h.last_recovery_ms);
+}
+
+static void sensor_health_task(void *arg) {
+    int64_t last_tick = esp_timer_get_time();
+    int64_t last_log = last_tick;
+    int64_t next_recovery = 0;
+    uint32_t backoff_ms = HEALTH_TICK_MS;
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(HEALTH_TICK_MS));
+        int64_t now = esp_timer_get_time();
+
+        if (!as608_is_online()) {
+            // Mất kết nối: khôi phục ngay, nếu thất bại thì giãn dần khoảng thử lại
+            if (now >= next_recovery) {
+                taskENTER_CRITICAL(&lock);
+                health.recovery_attempts++;
+                taskEXIT_CRITICAL(&lock);
+                int64_t start = esp_timer_get_time();
+                if (as608_recover()) {
+                    uint32_t ms = (uint32_t)((esp_timer_get_time() - start) / 1000);
+                    taskENTER_CRITICAL(&lock);
+                    health.recoveries++;
+                    health.last_recovery_ms = ms;
+                    taskEXIT_CRITICAL(&lock);
+                    backoff_ms = HEALTH_TICK_MS;
+                    ESP_LOGI(TAG, "AS608 recovered in %lu ms", (unsigned long)ms);
+                } else {
+                    backoff_ms = backoff_ms * 2 > RECOVERY_BACKOFF_MAX_MS ? RECOVERY_BACKOFF_MAX_MS : backoff_ms * 2;
+                    next_recovery = now + backoff_ms * 1000LL;
+                }
+            }
+        } else if (now - as608_last_activity_us() >= CONFIG_VANTAY_HEALTH_PROBE_INTERVAL_MS * 1000LL) {
+            // Thăm dò chỉ khi không có lệnh nào gần đây; bỏ qua nếu đang chấm công
+            bool busy;
+            bool ok = as608_probe(&busy);
+            if (!busy) {
+                taskENTER_CRITICAL(&lock);
+                health.probes++;
+                if (!ok) {
+                    health.probe_failures++;
+                }
+                taskEXIT_CRITICAL(&lock);
+            }
+        }
+
+        account(as608_is_online(), now - last_tick);
+        last_tick = now;
+
+        if (now - last_log >= HEALTH_LOG_INTERVAL_US) {
+            last_log = now;
+            log_health();
+        }
+    }
+}
+
+bool sensor_health_start(void) {
+    return sysmem_task_create(sensor_health_task, "sensor_health", CONFIG_VANTAY_HEALTH_TASK_STACK, NULL, 3) != NULL;
+}
+
+void sensor_health_get(sensor_health_t *out) {
+    taskENTER_CRITICAL(&lock);
+    *out = health;
+    taskEXIT_CRITICAL(&lock);
+}
@@ -0,0 +1,21 @@
+#ifndef _SENSOR_HEALTH_H_
+#define _SENSOR_HEALTH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    bool online;
+    uint32_t probes;
+    uint32_t probe_failures;
+    uint32_t recoveries;            // Số lần khôi phục thành công
+    uint32_t recovery_attempts;
+    uint32_t last_recovery_ms;      // Thời gian của lần khôi phục thành công gần nhất
+    uint32_t availability_permille; // Tỉ lệ thời gian cảm biến hoạt động (‰)
+} sensor_health_t;
+
+// Tạo task giám sát AS608: thăm dò khi rảnh, khôi phục khi mất kết nối
+bool sensor_health_start(void);
+void sensor_health_get(sensor_health_t *out);
+
+#endif
@@ -0,0 +1,405 @@
+#include "soak.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "as608_driver.h"
+#include "attendance_agg.h"
+#include "sensor_health.h"
+#include "timekeep.h"
+#include "sysmem.h"
+
+#define TAG "SOAK"
+
+#define SOAK_REPORT_INTERVAL_US (60 * 1000000LL)
+#define SOAK_WARMUP_US          (5 * 60 * 1000000LL)    // Lấy mốc heap sau khi mọi thứ đã khởi tạo xong
+#define SOAK_TIME_WAIT_US       (30 * 1000000LL)        // Chờ SNTP trước khi tự đặt giờ
+#define SOAK_DRAIN_TIMEOUT_US   (120 * 1000000LL)       // Chờ hàng chờ rỗng / cảm biến online khi kết thúc
+#define SOAK_CLOCK_RESTORE_US   (10 * 1000000LL)        // Thời gian giữ đồng hồ sai trước khi đặt lại
+#define SOAK_FALLBACK_EPOCH     1735689600              // 2025-01-01 00:00:00 UTC
+#define SOAK_BURST_EVERY        50                      // Trung bình 1 loạt chấm công dồn / 50 lượt
+#define SOAK_BURST_LEN          5
+
+typedef enum {
+    FAULT_UART_DROP,        // Thiếu byte cuối gói
+    FAULT_UART_CORRUPT,     // Sai checksum
+    FAULT_UART_TIMEOUT,     // Cảm biến không trả lời
+    FAULT_NET_OUTAGE,
+    FAULT_CLOCK_JUMP,
+    FAULT_COUNT
+} soak_fault_t;
+
+static const char *const fault_names[FAULT_COUNT] = {
+    "uart-drop", "uart-crc", "uart-timeout", "net-outage", "clock-jump",
+};
+
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t rng_state = CONFIG_VANTAY_SOAK_SEED;
+static uint32_t faults[FAULT_COUNT];
+static volatile bool faults_enabled = false;
+static volatile bool net_down = false;
+
+static const soak_target_t *target;
+static const uploader_t *inner_uploader;
+static uploader_result_cb_t app_on_result;
+static uint32_t delivered = 0;          // Bản ghi đã tới nơi (HTTP trả lời / broker xác nhận)
+static int64_t send_max_us = 0;
+static int64_t delivery_max_us = 0;     // Từ lúc chạm tới khi bản ghi tới nơi (gồm cả lúc mất mạng)
+
+// Thời điểm chạm của các lượt còn trong hàng chờ, theo seq, để đo tới khi tới nơi
+static struct {
+    uint32_t seq;
+    int64_t touch_us;   // 0 = không theo dõi
+} touches[CONFIG_VANTAY_PENDING_PUNCH_MAX];
+
+// Kết quả của lần chạy, chỉ soak_task ghi
+static struct {
+    uint32_t submitted;
+    int64_t queue_max_us;       // Từ lúc chạm tới khi lượt chấm công vào hàng chờ
+    uint32_t over_budget;
+    size_t heap_baseline;
+    bool failed;
+} run;
+
+// xorshift32: cùng seed cho cùng kịch bản
+static uint32_t soak_random(void) {
+    taskENTER_CRITICAL(&lock);
+    uint32_t x = rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rng_state = x;
+    taskEXIT_CRITICAL(&lock);
+    return x;
+}
+
+static void count_fault(soak_fault_t fault) {
+    taskENTER_CRITICAL(&lock);
+    faults[fault]++;
+    taskEXIT_CRITICAL(&lock);
+}
+
+int soak_filter_uart(uint8_t *buffer, int length) {
+    if (!faults_enabled || length <= 0 ||
+        soak_random() % 1000 >= CONFIG_VANTAY_SOAK_UART_FAULT_PERMILLE) {
+        return length;
+    }
+    soak_fault_t fault = FAULT_UART_DROP + soak_random() % 3;
+    count_fault(fault);
+    switch (fault) {
+    case FAULT_UART_DROP:
+        return length - 1;
+    case FAULT_UART_CORRUPT:
+        buffer[length - 1] ^= 0x5A;
+        return length;
+    default:
+        return 0;
+    }
+}
+
+// Backend bọc: mất mạng giả lập, đếm bản ghi đã tới nơi và độ trễ gửi
+static void soak_on_result(uint32_t seq, bool ok) {
+    if (ok) {
+        int64_t now = esp_timer_get_time();
+        int i = seq % CONFIG_VANTAY_PENDING_PUNCH_MAX;
+        taskENTER_CRITICAL(&lock);
+        delivered++;
+        if (touches[i].touch_us != 0 && touches[i].seq == seq) {
+            if (now - touches[i].touch_us > delivery_max_us) {
+                delivery_max_us = now - touches[i].touch_us;
+            }
+            touches[i].touch_us = 0;
+        }
+        taskEXIT_CRITICAL(&lock);
+    }
+    app_on_result(seq, ok);
+}
+
+static esp_err_t soak_uploader_start(uploader_result_cb_t on_result) {
+    app_on_result = on_result;
+#if CONFIG_VANTAY_SOAK_OFFLINE
+    return ESP_OK;
+#else
+    return inner_uploader->start(soak_on_result);
+#endif
+}
+
+static bool soak_uploader_ready(void) {
+#if CONFIG_VANTAY_SOAK_OFFLINE
+    return app_on_result != NULL && !net_down;
+#else
+    return !net_down && inner_uploader->ready();
+#endif
+}
+
+static int soak_uploader_send(const attendance_record_t *records, int count) {
+    if (net_down) {
+        return 0;
+    }
+    int64_t start = esp_timer_get_time();
+#if CONFIG_VANTAY_SOAK_OFFLINE
+    for (int i = 0; i < count; i++) {
+        soak_on_result(records[i].seq, true);
+    }
+    int accepted = count;
+#else
+    int accepted = inner_uploader->send(records, count);
+#endif
+    int64_t elapsed = esp_timer_get_time() - start;
+    taskENTER_CRITICAL(&lock);
+    if (elapsed > send_max_us) {
+        send_max_us = elapsed;
+    }
+    taskEXIT_CRITICAL(&lock);
+    return accepted;
+}
+
+static void soak_uploader_poll(void) {
+#if !CONFIG_VANTAY_SOAK_OFFLINE
+    if (inner_uploader->poll != NULL) {
+        inner_uploader->poll();
+    }
+#endif
+}
+
+static esp_err_t soak_uploader_send_summary(uint32_t day, const attendance_summary_t *entries, int count) {
+    if (net_down) {
+        return ESP_FAIL;
+    }
+#if CONFIG_VANTAY_SOAK_OFFLINE
+    return ESP_OK;
+#else
+    return inner_uploader->send_summary(day, entries, count);
+#endif
+}
+
+static const uploader_t soak_uploader = {
+    .name = "soak",
+    .start = soak_uploader_start,
+    .ready = soak_uploader_ready,
+    .send = soak_uploader_send,
+    .poll = soak_uploader_poll,
+    .send_summary = soak_uploader_send_summary,
+};
+
+const uploader_t *soak_wrap_uploader(const uploader_t *inner) {
+    inner_uploader = inner;
+    return &soak_uploader;
+}
+
+// Nhảy đồng hồ như một lần SNTP trả về giờ sai (hoặc sửa lại giờ)
+static void shift_clock(int32_t seconds) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    tv.tv_sec += seconds;
+    settimeofday(&tv, NULL);
+    timekeep_set_test_time(&tv);
+}
+
+static void wait_for_trusted_time(void) {
+    int64_t deadline = esp_timer_get_time() + SOAK_TIME_WAIT_US;
+    while (!timekeep_is_trusted() && esp_timer_get_time() < deadline) {
+        vTaskDelay(pdMS_TO_TICKS(1000));
+    }
+    if (!timekeep_is_trusted()) {
+        // Không có SNTP (chạy offline): đặt giờ cố định để lượt chấm công được gửi ngay
+        struct timeval tv = { .tv_sec = SOAK_FALLBACK_EPOCH, .tv_usec = 0 };
+        settimeofday(&tv, NULL);
+        timekeep_set_test_time(&tv);
+        ESP_LOGW(TAG, "No SNTP, using fixed time");
+    }
+}
+
+static void soak_report(int64_t elapsed_us) {
+    size_t free_now = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    size_t min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    uint32_t fault_counts[FAULT_COUNT];
+    uint32_t sent;
+    int64_t send_max;
+    int64_t delivery_max;
+    sensor_health_t health;
+    char fault_str[128];
+    int pos = 0;
+
+    taskENTER_CRITICAL(&lock);
+    memcpy(fault_counts, faults, sizeof(faults));
+    sent = delivered;
+    send_max = send_max_us;
+    delivery_max = delivery_max_us;
+    taskEXIT_CRITICAL(&lock);
+    sensor_health_get(&health);
+
+    for (int i = 0; i < FAULT_COUNT && pos < (int)sizeof(fault_str); i++) {
+        pos += snprintf(fault_str + pos, sizeof(fault_str) - pos, " %s=%lu",
+                        fault_names[i], (unsigned long)fault_counts[i]);
+    }
+    ESP_LOGI(TAG, "%lu s: punches %lu/%d, delivered %lu, pending %d, dropped %lu",
+             (unsigned long)(elapsed_us / 1000000), (unsigned long)run.submitted, CONFIG_VANTAY_SOAK_PUNCHES,
+             (unsigned long)sent, target->pending(), (unsigned long)target->dropped());
+    ESP_LOGI(TAG, "latency: touch to queued max %lld us (%lu over budget), touch to delivered max %lld us, "
+             "send max %lld us", (long long)run.queue_max_us, (unsigned long)run.over_budget,
+             (long long)delivery_max, (long long)send_max);
+    ESP_LOGI(TAG, "heap %u (min %u, largest %u), sensor availability %lu.%lu%%, faults:%s",
+             (unsigned)free_now, (unsigned)min_free, (unsigned)largest,
+             (unsigned long)(health.availability_permille / 10),
+             (unsigned long)(health.availability_permille % 10), fault_str);
+
+    // Heap không được giảm dần theo thời gian chạy
+    if (run.heap_baseline == 0) {
+        if (elapsed_us >= SOAK_WARMUP_US) {
+            run.heap_baseline = free_now;
+        }
+    } else if (free_now + CONFIG_VANTAY_SOAK_HEAP_GROWTH_BYTES < run.heap_baseline) {
+        ESP_LOGE(TAG, "FAIL: heap shrank by %u bytes since warm-up",
+                 (unsigned)(run.heap_baseline - free_now));
+        run.failed = true;
+    }
+    if (run.over_budget > 0) {
+        ESP_LOGE(TAG, "FAIL: %lu punch(es) over the %d ms latency budget",
+                 (unsigned long)run.over_budget, CONFIG_VANTAY_SOAK_LATENCY_BUDGET_MS);
+        run.failed = true;
+    }
+}
+
+// Một lượt chấm công giả lập như khi WAK báo có ngón tay: xác thực qua UART thật của driver
+// (lỗi UART chèn vào đi qua đúng đường này), rồi đưa lượt chấm công vào hàng chờ. Không có ngón
+// tay thật nên kết quả xác thực bị bỏ qua và slot lấy từ kịch bản. Đo từ lúc chạm.
+static void punch_timed(uint16_t slot) {
+    uint16_t matched_id;
+    uint16_t score;
+    int64_t touch = esp_timer_get_time();
+    if (as608_is_online()) {
+        as608_verify_fingerprint(&matched_id, &score, true);
+    }
+    uint32_t seq = target->submit(slot);
+    int64_t elapsed = esp_timer_get_time() - touch;
+
+    int i = seq % CONFIG_VANTAY_PENDING_PUNCH_MAX;
+    taskENTER_CRITICAL(&lock);
+    touches[i].seq = seq;
+    touches[i].touch_us = touch;
+    taskEXIT_CRITICAL(&lock);
+
+    if (elapsed > run.queue_max_us) {
+        run.queue_max_us = elapsed;
+    }
+    if (elapsed > CONFIG_VANTAY_SOAK_LATENCY_BUDGET_MS * 1000LL) {
+        run.over_budget++;
+    }
+    run.submitted++;
+}
+
+// Chờ hệ thống tự hồi phục sau khi ngừng chèn lỗi
+static void wait_settled(bool sensor_was_online) {
+    int64_t deadline = esp_timer_get_time() + SOAK_DRAIN_TIMEOUT_US;
+    while (esp_timer_get_time() < deadline &&
+           (target->pending() > 0 || (sensor_was_online && !as608_is_online()))) {
+        vTaskDelay(pdMS_TO_TICKS(1000));
+    }
+    if (sensor_was_online && !as608_is_online()) {
+        ESP_LOGE(TAG, "FAIL: AS608 did not recover after faults stopped");
+        run.failed = true;
+    }
+}
+
+static void soak_task(void *arg) {
+    wait_for_trusted_time();
+    bool sensor_was_online = as608_is_online();
+
+    int64_t start = esp_timer_get_time();
+    int64_t next_report = start + SOAK_REPORT_INTERVAL_US;
+    int64_t next_outage = start + CONFIG_VANTAY_SOAK_OUTAGE_INTERVAL_S * 1000000LL;
+    int64_t outage_end = 0;
+    int64_t next_jump = start + CONFIG_VANTAY_SOAK_CLOCK_JUMP_INTERVAL_S * 1000000LL;
+    int64_t jump_restore = 0;
+    int32_t jump_s = 0;
+
+    ESP_LOGI(TAG, "Soak started: %d punches every %d ms, seed %d, backend %s", CONFIG_VANTAY_SOAK_PUNCHES,
+             CONFIG_VANTAY_SOAK_PUNCH_INTERVAL_MS, CONFIG_VANTAY_SOAK_SEED,
+#if CONFIG_VANTAY_SOAK_OFFLINE
+             "none");
+#else
+             inner_uploader->name);
+#endif
+    faults_enabled = true;
+
+    while (run.submitted < CONFIG_VANTAY_SOAK_PUNCHES) {
+        int64_t now = esp_timer_get_time();
+
+        if (CONFIG_VANTAY_SOAK_OUTAGE_INTERVAL_S > 0) {
+            if (!net_down && now >= next_outage) {
+                net_down = true;
+                outage_end = now + CONFIG_VANTAY_SOAK_OUTAGE_DURATION_S * 1000000LL;
+                count_fault(FAULT_NET_OUTAGE);
+                ESP_LOGW(TAG, "Network outage for %d s", CONFIG_VANTAY_SOAK_OUTAGE_DURATION_S);
+            } else if (net_down && now >= outage_end) {
+                net_down = false;
+                next_outage = now + CONFIG_VANTAY_SOAK_OUTAGE_INTERVAL_S * 1000000LL;
+                ESP_LOGW(TAG, "Network restored");
+            }
+        }
+        if (CONFIG_VANTAY_SOAK_CLOCK_JUMP_INTERVAL_S > 0) {
+            if (jump_s == 0 && now >= next_jump) {
+                jump_s = (soak_random() & 1) ? CONFIG_VANTAY_SOAK_CLOCK_JUMP_S : -CONFIG_VANTAY_SOAK_CLOCK_JUMP_S;
+                shift_clock(jump_s);
+                jump_restore = now + SOAK_CLOCK_RESTORE_US;
+                count_fault(FAULT_CLOCK_JUMP);
+                ESP_LOGW(TAG, "Clock jump %+ld s", (long)jump_s);
+            } else if (jump_s != 0 && now >= jump_restore) {
+                shift_clock(-jump_s);
+                jump_s = 0;
+                next_jump = now + CONFIG_VANTAY_SOAK_CLOCK_JUMP_INTERVAL_S * 1000000LL;
+            }
+        }
+
+        // Chấm công theo kịch bản: phần lớn từng lượt, thỉnh thoảng một loạt dồn dập
+        int burst = (soak_random() % SOAK_BURST_EVERY == 0) ? SOAK_BURST_LEN : 1;
+        for (int i = 0; i < burst && run.submitted < CONFIG_VANTAY_SOAK_PUNCHES; i++) {
+            punch_timed(soak_random() % AGG_SLOT_COUNT);
+        }
+
+        if (now >= next_report) {
+            soak_report(now - start);
+            next_report = now + SOAK_REPORT_INTERVAL_US;
+        }
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_VANTAY_SOAK_PUNCH_INTERVAL_MS));
+    }
+
+    // Ngừng chèn lỗi, đặt lại đồng hồ và chờ mọi lượt chấm công được gửi
+    faults_enabled = false;
+    net_down = false;
+    if (jump_s != 0) {
+        shift_clock(-jump_s);
+    }
+    wait_settled(sensor_was_online);
+    soak_report(esp_timer_get_time() - start);
+
+    uint32_t sent;
+    taskENTER_CRITICAL(&lock);
+    sent = delivered;
+    taskEXIT_CRITICAL(&lock);
+    if (sent < run.submitted) {
+        ESP_LOGE(TAG, "FAIL: lost %lu of %lu punches (%lu dropped on full queue, %d still pending)",
+                 (unsigned long)(run.submitted - sent), (unsigned long)run.submitted,
+                 (unsigned long)target->dropped(), target->pending());
+        run.failed = true;
+    }
+    sysmem_report();
+    if (run.failed) {
+        ESP_LOGE(TAG, "SOAK FAILED");
+    } else {
+        ESP_LOGI(TAG, "SOAK PASSED");
+    }
+    // Không xóa task: sysmem_report vẫn đọc stack high-water mark qua handle này
+    vTaskSuspend(NULL);
+}
+
+bool soak_start(const soak_target_t *soak_target) {
+    target = soak_target;
+    return sysmem_task_create(soak_task, "soak_task", CONFIG_VANTAY_SOAK_TASK_STACK, NULL, 3) != NULL;
+}
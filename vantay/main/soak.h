@@ -0,0 +1,33 @@
+#ifndef _SOAK_H_
+#define _SOAK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "uploader.h"
+
+// Bộ kiểm thử chạy dài trên thiết bị (CONFIG_VANTAY_SOAK_TEST): phát lượt chấm công
+// theo kịch bản (chạm giả lập -> xác thực qua UART của AS608 -> hàng chờ), chèn lỗi
+// UART / mạng / đồng hồ và kiểm tra độ trễ, heap, mất bản ghi.
+
+// Đường chấm công của ứng dụng mà bộ kiểm thử điều khiển
+typedef struct {
+    uint32_t (*submit)(uint16_t id);    // Trả về seq của lượt chấm công
+    int (*pending)(void);           // Số lượt đang chờ gửi
+    uint32_t (*dropped)(void);      // Số lượt đã bỏ vì hàng chờ đầy
+} soak_target_t;
+
+#if CONFIG_VANTAY_SOAK_TEST
+bool soak_start(const soak_target_t *target);
+
+// Bọc backend thật: giả lập mất mạng và đếm bản ghi đã gửi
+const uploader_t *soak_wrap_uploader(const uploader_t *inner);
+
+// Gọi sau mỗi lần đọc UART của AS608; có thể làm rơi byte, hỏng checksum hoặc
+// giả lập hết thời gian chờ. Trả về số byte coi như đã đọc.
+int soak_filter_uart(uint8_t *buffer, int length);
+#else
+#define soak_filter_uart(buffer, length) (length)
+#endif
+
+#endif
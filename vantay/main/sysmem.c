@@ -0,0 +1,119 @@
+#include "sysmem.h"
+#include <string.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "sdkconfig.h"
+
+#define TAG "SYSMEM"
+
+#define SYSMEM_MAX_TASKS 12     // Số task tối đa được theo dõi trong báo cáo
+
+// Ký hiệu từ linker script: giới hạn vùng .data và .bss
+extern uint8_t _data_start, _data_end, _bss_start, _bss_end;
+
+typedef struct {
+    TaskHandle_t handle;
+    const char *name;
+    uint32_t stack_size;
+} sysmem_task_info_t;
+
+static sysmem_task_info_t tracked_tasks[SYSMEM_MAX_TASKS];
+static int tracked_task_count = 0;
+
+#if CONFIG_VANTAY_STATIC_ALLOC
+// Vùng nhớ tĩnh: cấp phát tuyến tính, không bao giờ giải phóng
+static uint8_t arena[CONFIG_VANTAY_STATIC_ARENA_SIZE] __attribute__((aligned(8)));
+static size_t arena_used = 0;
+
+static void *arena_alloc(size_t size) {
+    size = (size + 7) & ~(size_t)7;     // Căn lề 8 byte
+    if (arena_used + size > sizeof(arena)) {
+        ESP_LOGE(TAG, "Static arena exhausted: need %u, %u/%u used",
+                 (unsigned)size, (unsigned)arena_used, (unsigned)sizeof(arena));
+        return NULL;
+    }
+    void *p = &arena[arena_used];
+    arena_used += size;
+    return p;
+}
+#endif
+
+static void track_task(TaskHandle_t handle, const char *name, uint32_t stack_size) {
+    if (handle == NULL || tracked_task_count >= SYSMEM_MAX_TASKS) {
+        return;
+    }
+    tracked_tasks[tracked_task_count].handle = handle;
+    tracked_tasks[tracked_task_count].name = name;
+    tracked_tasks[tracked_task_count].stack_size = stack_size;
+    tracked_task_count++;
+}
+
+TaskHandle_t sysmem_task_create(TaskFunction_t fn, const char *name, uint32_t stack_size,
+                                void *arg, UBaseType_t priority) {
+    TaskHandle_t handle = NULL;
+#if CONFIG_VANTAY_STATIC_ALLOC
+    StaticTask_t *tcb = arena_alloc(sizeof(StaticTask_t));
+    StackType_t *stack = arena_alloc(stack_size);
+    if (tcb == NULL || stack == NULL) {
+        return NULL;
+    }
+    handle = xTaskCreateStatic(fn, name, stack_size, arg, priority, stack, tcb);
+#else
+    if (xTaskCreate(fn, name, stack_size, arg, priority, &handle) != pdPASS) {
+        handle = NULL;
+    }
+#endif
+    if (handle == NULL) {
+        ESP_LOGE(TAG, "Failed to create task %s", name);
+    }
+    track_task(handle, name, stack_size);
+    return handle;
+}
+
+QueueHandle_t sysmem_queue_create(UBaseType_t length, UBaseType_t item_size) {
+#if CONFIG_VANTAY_STATIC_ALLOC
+    StaticQueue_t *queue_buf = arena_alloc(sizeof(StaticQueue_t));
+    uint8_t *storage = arena_alloc(length * item_size);
+    if (queue_buf == NULL || storage == NULL) {
+        return NULL;
+    }
+    return xQueueCreateStatic(length, item_size, storage, queue_buf);
+#else
+    return xQueueCreate(length, item_size);
+#endif
+}
+
+SemaphoreHandle_t sysmem_mutex_create(void) {
+#if CONFIG_VANTAY_STATIC_ALLOC
+    StaticSemaphore_t *sem_buf = arena_alloc(sizeof(StaticSemaphore_t));
+    if (sem_buf == NULL) {
+        return NULL;
+    }
+    return xSemaphoreCreateMutexStatic(sem_buf);
+#else
+    return xSemaphoreCreateMutex();
+#endif
+}
+
+void sysmem_report(void) {
+    size_t data_size = &_data_end - &_data_start;
+    size_t bss_size = &_bss_end - &_bss_start;
+    ESP_LOGI(TAG, "Static RAM: .data %u B, .bss %u B", (unsigned)data_size, (unsigned)bss_size);
+#if CONFIG_VANTAY_STATIC_ALLOC
+    ESP_LOGI(TAG, "Static arena: %u/%u B used", (unsigned)arena_used, (unsigned)sizeof(arena));
+#endif
+
+    // Heap thấp nhất từng đạt cho biết mức sử dụng heap cao nhất kể từ khi khởi động
+    size_t total = heap_caps_get_total_size(MALLOC_CAP_8BIT);
+    size_t free_now = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    size_t min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    ESP_LOGI(TAG, "Heap: free %u B, peak used %u B, min free %u B, largest block %u B",
+             (unsigned)free_now, (unsigned)(total - min_free), (unsigned)min_free, (unsigned)largest);
+
+    for (int i = 0; i < tracked_task_count; i++) {
+        UBaseType_t hwm = uxTaskGetStackHighWaterMark(tracked_tasks[i].handle);
+        ESP_LOGI(TAG, "Task %-16s stack %5u B, high-water %5u B free",
+                 tracked_tasks[i].name, (unsigned)tracked_tasks[i].stack_size, (unsigned)hwm);
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef _SYSMEM_H_
+#define _SYSMEM_H_
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+// Tạo task/queue/semaphore: từ vùng nhớ tĩnh nếu bật CONFIG_VANTAY_STATIC_ALLOC,
+// ngược lại từ heap. Chỉ gọi trong giai đoạn khởi động.
+TaskHandle_t sysmem_task_create(TaskFunction_t fn, const char *name, uint32_t stack_size,
+                                void *arg, UBaseType_t priority);
+QueueHandle_t sysmem_queue_create(UBaseType_t length, UBaseType_t item_size);
+SemaphoreHandle_t sysmem_mutex_create(void);
+
+// In báo cáo bộ nhớ: RAM tĩnh, heap hiện tại/thấp nhất, stack high-water mark
+void sysmem_report(void);
+
+#endif
@@ -0,0 +1,217 @@
+#include "timekeep.h"
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_rtc_time.h"
+#include "esp_system.h"
+#include "nvs.h"
+
+#define TAG "TIMEKEEP"
+
+#define RTC_ANCHOR_MAGIC        0x54494D45  // "TIME"
+#define NVS_NAMESPACE           "timekeep"
+#define NVS_CHECKPOINT_US       (10 * 60 * 1000000LL)   // Ghi NVS mỗi 10 phút
+#define SYNC_UNCERTAINTY_MS     50          // Sai số ngay sau khi đồng bộ SNTP
+#define XTAL_DRIFT_BOUND_PPM    30          // Sai số còn lại của đồng hồ hệ thống sau hiệu chỉnh
+#define RTC_DRIFT_BOUND_PPM     2000        // Sai số của bộ đếm RTC (RC nội) qua reset
+#define TRUSTED_UNCERTAINTY_MS  2000        // Ngưỡng để coi thời gian là tin cậy
+#define MIN_DRIFT_LEARN_US      (10 * 60 * 1000000LL)   // Khoảng tối thiểu giữa 2 lần học độ trôi
+#define MAX_DRIFT_LEARN_PPB     200000      // Lớn hơn 200 ppm là giờ bị nhảy, không phải độ trôi
+
+// Mốc thời gian lưu trong RTC memory, giữ qua reset mềm / watchdog / panic
+typedef struct {
+    uint32_t magic;
+    int64_t epoch_us;           // Thời gian thực tại mốc
+    uint64_t rtc_us;            // Bộ đếm RTC tại mốc
+    uint32_t uncertainty_ms;    // Sai số tại mốc
+    int32_t drift_ppb;          // Độ trôi đã học của đồng hồ hệ thống
+    uint8_t source;
+} rtc_anchor_t;
+
+static RTC_NOINIT_ATTR rtc_anchor_t rtc_anchor;
+
+// Mốc của lần chạy hiện tại, đo bằng esp_timer (thạch anh)
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t anchor_epoch_us = 0;
+static int64_t anchor_mono_us = 0;
+static uint32_t anchor_uncertainty_ms = TIMEKEEP_UNBOUNDED;
+static int32_t drift_ppb = 0;
+static timekeep_source_t source = TIMEKEEP_SRC_NONE;
+static int64_t last_sync_epoch_us = 0;
+static int64_t last_sync_mono_us = -1;
+static int64_t last_nvs_write_us = 0;
+static bool test_time = false;  // Giờ do soak đặt: không lưu RTC/NVS đến lần SNTP thật sau
+
+static void set_anchor(int64_t epoch_us, int64_t mono_us, uint32_t uncertainty_ms, timekeep_source_t src) {
+    anchor_epoch_us = epoch_us;
+    anchor_mono_us = mono_us;
+    anchor_uncertainty_ms = uncertainty_ms;
+    source = src;
+}
+
+static void load_nvs(int64_t *epoch_us, int32_t *drift) {
+    nvs_handle_t nvs;
+    *epoch_us = 0;
+    *drift = 0;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return;
+    }
+    nvs_get_i64(nvs, "epoch", epoch_us);
+    nvs_get_i32(nvs, "drift", drift);
+    nvs_close(nvs);
+}
+
+static void save_nvs(int64_t epoch_us, int32_t drift) {
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS");
+        return;
+    }
+    nvs_set_i64(nvs, "epoch", epoch_us);
+    nvs_set_i32(nvs, "drift", drift);
+    nvs_commit(nvs);
+    nvs_close(nvs);
+}
+
+void timekeep_init(void) {
+    int64_t nvs_epoch_us;
+    int32_t nvs_drift;
+    int64_t mono = esp_timer_get_time();
+    esp_reset_reason_t reason = esp_reset_reason();
+
+    load_nvs(&nvs_epoch_us, &nvs_drift);
+    drift_ppb = nvs_drift;
+
+    // Múi giờ Việt Nam (GMT+7)
+    setenv("TZ", "UTC-7", 1);
+    tzset();
+
+    if (reason != ESP_RST_POWERON && reason != ESP_RST_BROWNOUT &&
+        rtc_anchor.magic == RTC_ANCHOR_MAGIC && rtc_anchor.source != TIMEKEEP_SRC_NONE) {
+        // Reset mềm: bộ đếm RTC vẫn chạy, cộng thêm thời gian đã trôi
+        uint64_t elapsed_us = esp_rtc_get_time_us() - rtc_anchor.rtc_us;
+        uint64_t unc = rtc_anchor.uncertainty_ms;
+        if (unc != TIMEKEEP_UNBOUNDED) {
+            unc += elapsed_us * RTC_DRIFT_BOUND_PPM / 1000000000ULL + 10;
+        }
+        drift_ppb = rtc_anchor.drift_ppb;
+        set_anchor(rtc_anchor.epoch_us + elapsed_us, mono,
+                   unc > TIMEKEEP_UNBOUNDED ? TIMEKEEP_UNBOUNDED : (uint32_t)unc,
+                   rtc_anchor.source == TIMEKEEP_SRC_NVS ? TIMEKEEP_SRC_NVS : TIMEKEEP_SRC_RTC);
+    } else if (nvs_epoch_us > 0) {
+        // Mất nguồn: chỉ biết thời gian không sớm hơn mốc NVS cuối cùng
+        set_anchor(nvs_epoch_us, mono, TIMEKEEP_UNBOUNDED, TIMEKEEP_SRC_NVS);
+    } else {
+        set_anchor(0, mono, TIMEKEEP_UNBOUNDED, TIMEKEEP_SRC_NONE);
+    }
+
+    struct timeval tv = {
+        .tv_sec = anchor_epoch_us / 1000000,
+        .tv_usec = anchor_epoch_us % 1000000,
+    };
+    settimeofday(&tv, NULL);
+    ESP_LOGI(TAG, "Time restored from %s, uncertainty %lu ms, drift %ld ppb",
+             source == TIMEKEEP_SRC_RTC ? "RTC" : source == TIMEKEEP_SRC_NVS ? "NVS" : "nothing",
+             (unsigned long)anchor_uncertainty_ms, (long)drift_ppb);
+}
+
+// Ước lượng thời gian tại mono_us từ mốc hiện tại, có hiệu chỉnh độ trôi. Gọi khi đang giữ lock.
+static void estimate_locked(int64_t mono_us, int64_t *epoch_us, uint32_t *uncertainty_ms) {
+    int64_t elapsed = mono_us - anchor_mono_us;
+    *epoch_us = anchor_epoch_us + elapsed + elapsed * drift_ppb / 1000000000LL;
+    if (anchor_uncertainty_ms == TIMEKEEP_UNBOUNDED) {
+        *uncertainty_ms = TIMEKEEP_UNBOUNDED;
+        return;
+    }
+    uint64_t unc = anchor_uncertainty_ms + (uint64_t)llabs(elapsed) * XTAL_DRIFT_BOUND_PPM / 1000000000ULL;
+    *uncertainty_ms = unc >= TIMEKEEP_UNBOUNDED ? TIMEKEEP_UNBOUNDED : (uint32_t)unc;
+}
+
+void timekeep_stamp(int64_t mono_us, time_t *epoch, uint32_t *uncertainty_ms) {
+    int64_t epoch_us;
+    taskENTER_CRITICAL(&lock);
+    estimate_locked(mono_us, &epoch_us, uncertainty_ms);
+    taskEXIT_CRITICAL(&lock);
+    *epoch = (time_t)(epoch_us / 1000000);
+}
+
+bool timekeep_is_trusted(void) {
+    time_t epoch;
+    uint32_t unc;
+    timekeep_stamp(esp_timer_get_time(), &epoch, &unc);
+    return unc <= TRUSTED_UNCERTAINTY_MS;
+}
+
+timekeep_source_t timekeep_source(void) {
+    return source;
+}
+
+void timekeep_on_sync(const struct timeval *tv) {
+    int64_t mono = esp_timer_get_time();
+    int64_t true_us = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+
+    taskENTER_CRITICAL(&lock);
+    // Học độ trôi: so sánh thời gian thật với dự đoán chưa hiệu chỉnh từ lần đồng bộ trước
+    int64_t elapsed = mono - last_sync_mono_us;
+    if (last_sync_mono_us >= 0 && elapsed >= MIN_DRIFT_LEARN_US) {
+        int64_t error_us = true_us - (last_sync_epoch_us + elapsed);
+        // So sánh trước khi nhân để không tràn số khi giờ bị nhảy xa
+        if (llabs(error_us) <= elapsed / (1000000000LL / MAX_DRIFT_LEARN_PPB)) {
+            int32_t measured_ppb = (int32_t)(error_us * 1000000000LL / elapsed);
+            drift_ppb += (measured_ppb - drift_ppb) / 4;    // Trung bình trượt
+        } else {
+            ESP_LOGW(TAG, "Ignoring clock jump of %lld ms when learning drift", (long long)(error_us / 1000));
+        }
+    }
+    last_sync_epoch_us = true_us;
+    last_sync_mono_us = mono;
+    set_anchor(true_us, mono, SYNC_UNCERTAINTY_MS, TIMEKEEP_SRC_SNTP);
+    test_time = false;
+    taskEXIT_CRITICAL(&lock);
+
+    ESP_LOGI(TAG, "SNTP sync, drift %ld ppb", (long)drift_ppb);
+    last_nvs_write_us = mono;
+    save_nvs(true_us, drift_ppb);
+}
+
+void timekeep_set_test_time(const struct timeval *tv) {
+    int64_t mono = esp_timer_get_time();
+    int64_t test_us = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+
+    // Không học độ trôi, không đổi mốc đồng bộ thật: lần SNTP sau vẫn so với lần trước đó
+    taskENTER_CRITICAL(&lock);
+    set_anchor(test_us, mono, SYNC_UNCERTAINTY_MS, TIMEKEEP_SRC_SNTP);
+    test_time = true;
+    taskEXIT_CRITICAL(&lock);
+    ESP_LOGW(TAG, "Test time set, RTC/NVS checkpoints paused until next SNTP sync");
+}
+
+void timekeep_checkpoint(void) {
+    uint64_t rtc_us = esp_rtc_get_time_us();
+    int64_t mono = esp_timer_get_time();
+    int64_t epoch_us;
+    uint32_t unc;
+
+    taskENTER_CRITICAL(&lock);
+    if (test_time) {
+        // Giữ mốc RTC cũ (vẫn đúng vì lưu kèm bộ đếm RTC), không để giờ giả sống qua reset
+        taskEXIT_CRITICAL(&lock);
+        return;
+    }
+    estimate_locked(mono, &epoch_us, &unc);
+    rtc_anchor.epoch_us = epoch_us;
+    rtc_anchor.rtc_us = rtc_us;
+    rtc_anchor.uncertainty_ms = unc;
+    rtc_anchor.drift_ppb = drift_ppb;
+    rtc_anchor.source = source;
+    rtc_anchor.magic = RTC_ANCHOR_MAGIC;
+    taskEXIT_CRITICAL(&lock);
+
+    // Chỉ lưu NVS khi mốc có ý nghĩa, hạn chế ghi flash
+    if (source != TIMEKEEP_SRC_NONE && mono - last_nvs_write_us >= NVS_CHECKPOINT_US) {
+        last_nvs_write_us = mono;
+        save_nvs(epoch_us, drift_ppb);
+    }
+}
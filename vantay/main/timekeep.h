@@ -0,0 +1,38 @@
+#ifndef _TIMEKEEP_H_
+#define _TIMEKEEP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/time.h>
+
+// Nguồn của thời gian hiện tại, theo độ tin cậy giảm dần
+typedef enum {
+    TIMEKEEP_SRC_SNTP,      // Đã đồng bộ SNTP trong lần chạy này
+    TIMEKEEP_SRC_RTC,       // Khôi phục từ RTC sau reset mềm
+    TIMEKEEP_SRC_NVS,       // Chỉ có mốc NVS sau mất nguồn (cận dưới)
+    TIMEKEEP_SRC_NONE
+} timekeep_source_t;
+
+#define TIMEKEEP_UNBOUNDED UINT32_MAX   // Không giới hạn được sai số
+
+// Khôi phục thời gian từ RTC/NVS ngay khi khởi động, không cần mạng. Gọi sau nvs_flash_init().
+void timekeep_init(void);
+
+// Đóng dấu thời gian cho một mốc esp_timer_get_time() (quá khứ hoặc hiện tại).
+// Gọi lại sau khi SNTP đồng bộ để đóng dấu lại bản ghi cũ với sai số nhỏ hơn.
+void timekeep_stamp(int64_t mono_us, time_t *epoch, uint32_t *uncertainty_ms);
+
+// Thời gian đã đủ tin cậy để gửi đi (sai số dưới ngưỡng)
+bool timekeep_is_trusted(void);
+timekeep_source_t timekeep_source(void);
+
+// Gọi từ callback SNTP: cập nhật mốc và học độ trôi của đồng hồ
+void timekeep_on_sync(const struct timeval *tv);
+// Đặt giờ giả cho kiểm thử (soak): như đồng bộ nhưng không học độ trôi và không lưu
+// mốc vào RTC/NVS cho đến lần SNTP thật tiếp theo
+void timekeep_set_test_time(const struct timeval *tv);
+
+// Gọi định kỳ (mỗi giây): lưu mốc vào RTC, và vào NVS theo chu kỳ dài hơn
+void timekeep_checkpoint(void);
+
+#endif
@@ -0,0 +1,103 @@
+#include "uploader.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "sdkconfig.h"
+#include "record_codec.h"
+#include "timekeep.h"
+#include "directory.h"
+#include "soak.h"
+
+static const uploader_t *uploader_backend(void) {
+#if CONFIG_VANTAY_UPLOADER_MQTT
+    return &uploader_mqtt;
+#else
+    return &uploader_http;
+#endif
+}
+
+const uploader_t *uploader_get(void) {
+#if CONFIG_VANTAY_SOAK_TEST
+    // Bộ kiểm thử đứng giữa để chèn lỗi mạng và đếm bản ghi
+    return soak_wrap_uploader(uploader_backend());
+#else
+    return uploader_backend();
+#endif
+}
+
+// JSON cho một bản ghi, cùng dạng Google Sheets đang nhận
+size_t uploader_format_json(const attendance_record_t *record, char *buf, size_t cap) {
+    time_t epoch = record->epoch;
+    struct tm timeinfo;
+    char time_str[32];
+
+    localtime_r(&epoch, &timeinfo);
+    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", &timeinfo);
+    const directory_employee_t *employee = directory_lookup(record->slot);
+    int n = snprintf(buf, cap, "{\"ID\": \"%d\", \"Code\": \"%.*s\", \"Time\": \"%s\", \"Uncertainty\": \"%ld\", "
+                     "\"Seq\": \"%lu\"}",
+                     record->slot, DIRECTORY_CODE_LEN, employee != NULL ? employee->code : "", time_str,
+                     record->uncertainty_ms == TIMEKEEP_UNBOUNDED ? -1L : (long)record->uncertainty_ms,
+                     (unsigned long)record->seq);
+    return (n < 0 || (size_t)n >= cap) ? 0 : (size_t)n;
+}
+
+// Nhiều bản ghi trong một gói nhị phân (record_codec.h), không dùng hàm định dạng chuỗi
+size_t uploader_format_binary(const attendance_record_t *records, int count, uint8_t *buf, size_t cap) {
+    record_writer_t writer;
+    if (count <= 0 || !record_writer_begin(&writer, buf, cap, CONFIG_VANTAY_DEVICE_ID,
+                                           records[0].epoch, records[0].seq)) {
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        if (!record_writer_add(&writer, records[i].slot, records[i].seq, records[i].epoch,
+                               records[i].uncertainty_ms)) {
+            return 0;
+        }
+    }
+    return writer.len;
+}
+
+// {"Day": "2025-10-09", "Rows": [[slot, first, last, total], ...]}
+size_t uploader_format_summary_json(uint32_t day, const attendance_summary_t *entries, int count,
+                                    char *buf, size_t cap, int *consumed) {
+    const size_t tail = 3;      // "]}" + '\0'
+    int n = snprintf(buf, cap, "{\"Day\": \"%04lu-%02lu-%02lu\", \"Rows\": [",
+                     (unsigned long)(day / 10000), (unsigned long)(day / 100 % 100), (unsigned long)(day % 100));
+    size_t len = (n > 0) ? (size_t)n : 0;
+    int i = 0;
+
+    *consumed = 0;
+    if (len + tail >= cap) {
+        return 0;
+    }
+    for (; i < count; i++) {
+        n = snprintf(buf + len, cap - len, "%s[%d, %d, %d, %d]", i > 0 ? ", " : "",
+                     entries[i].slot, entries[i].first_min, entries[i].last_min, entries[i].total_min);
+        if (n < 0 || len + n + tail >= cap) {
+            break;
+        }
+        len += n;
+    }
+    if (i == 0 && count > 0) {
+        return 0;
+    }
+    memcpy(buf + len, "]}", tail);
+    *consumed = i;
+    return len + tail - 1;
+}
+
+size_t uploader_format_summary_binary(uint32_t day, const attendance_summary_t *entries, int count,
+                                      uint8_t *buf, size_t cap) {
+    record_writer_t writer;
+    if (!summary_writer_begin(&writer, buf, cap, CONFIG_VANTAY_DEVICE_ID, day)) {
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        if (!summary_writer_add(&writer, entries[i].slot, entries[i].first_min,
+                                entries[i].last_min, entries[i].total_min)) {
+            return 0;
+        }
+    }
+    return writer.len;
+}
@@ -0,0 +1,60 @@
+#ifndef _UPLOADER_H_
+#define _UPLOADER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define UPLOADER_BATCH_MAX 32   // Số bản ghi tối đa trong một lần gửi
+
+// Bản ghi chấm công đã đóng dấu thời gian
+typedef struct {
+    uint16_t slot;
+    uint32_t seq;               // Số thứ tự lượt chấm công trên thiết bị, giữ nguyên khi gửi lại
+    uint32_t epoch;             // Giây Unix
+    uint32_t uncertainty_ms;    // TIMEKEEP_UNBOUNDED nếu không giới hạn
+} attendance_record_t;
+
+// Tổng hợp một ngày của một vị trí vân tay (phút tính từ nửa đêm, giờ địa phương)
+typedef struct {
+    uint16_t slot;
+    uint16_t first_min;         // Giờ vào đầu tiên
+    uint16_t last_min;          // Giờ ra cuối cùng
+    uint16_t total_min;         // Tổng thời gian có mặt
+} attendance_summary_t;
+
+// Kết quả của một bản ghi đã được send() nhận: delivered = đã tới nơi, false = phải gửi lại
+typedef void (*uploader_result_cb_t)(uint32_t seq, bool delivered);
+
+// Giao diện chung của các backend gửi dữ liệu. Các hàm không an toàn đa luồng,
+// người gọi phải gọi send(), poll() và send_summary() từ cùng một task.
+typedef struct {
+    const char *name;
+    esp_err_t (*start)(uploader_result_cb_t on_result);    // Gọi sau khi có Wi-Fi
+    bool (*ready)(void);        // Đã có thể gửi
+    // Nhận các bản ghi đầu lô, trả về số đã nhận (0..count); người gọi giữ phần còn lại để gửi lại.
+    // Mỗi bản ghi đã nhận được báo đúng một lần qua on_result: ngay trong send() (HTTP) hoặc
+    // trong poll() sau khi broker xác nhận (MQTT). Không chờ khi cửa sổ gửi đã đầy.
+    int (*send)(const attendance_record_t *records, int count);
+    void (*poll)(void);         // Xử lý kết quả đến sau; NULL nếu backend không cần
+    // day dạng YYYYMMDD
+    esp_err_t (*send_summary)(uint32_t day, const attendance_summary_t *entries, int count);
+} uploader_t;
+
+extern const uploader_t uploader_http;
+extern const uploader_t uploader_mqtt;
+
+// Backend được chọn trong menuconfig
+const uploader_t *uploader_get(void);
+
+// Định dạng dùng chung cho các backend
+size_t uploader_format_json(const attendance_record_t *record, char *buf, size_t cap);
+size_t uploader_format_binary(const attendance_record_t *records, int count, uint8_t *buf, size_t cap);
+// JSON tổng hợp ngày; *consumed là số dòng đã đưa vào buf (gọi lại với phần còn lại)
+size_t uploader_format_summary_json(uint32_t day, const attendance_summary_t *entries, int count,
+                                    char *buf, size_t cap, int *consumed);
+size_t uploader_format_summary_binary(uint32_t day, const attendance_summary_t *entries, int count,
+                                      uint8_t *buf, size_t cap);
+
+#endif
@@ -0,0 +1,180 @@
+#include "uploader.h"
+#include <string.h>
+#include "esp_log.h"
+#include "esp_http_client.h"
+#include "esp_crt_bundle.h"
+#include "connectwifi.h"
+#include "record_codec.h"
+#include "attendance_agg.h"
+
+#define TAG "UPLOADER_HTTP"
+
+#define GOOGLE_SHEET_URL "https://script.google.com/macros/s/AKfycbw4HQ2KZkdjLaZnehB2p2fkW8hkoliwpv7bES5tl_1tUrOCP9p5SHh6K9-A5XreJvQ-tg/exec"
+
+#if CONFIG_VANTAY_WIRE_FORMAT_BINARY
+#define UPLOAD_URL CONFIG_VANTAY_RECORD_RECEIVER_URL
+#else
+#define UPLOAD_URL GOOGLE_SHEET_URL
+#endif
+
+// HTTP client dùng chung cho mọi lần gửi, tạo một lần trong http_start().
+// Bộ đệm RX/TX (CONFIG_VANTAY_HTTP_BUFFER_SIZE) được cấp phát cùng client lúc khởi động
+// và dùng lại mãi. Heap còn lại mà esp_http_client dùng: ngữ cảnh mbedTLS cùng bộ đệm
+// bản ghi TLS (CONFIG_MBEDTLS_SSL_IN/OUT_CONTENT_LEN) mỗi lần (kết nối lại), và chuỗi
+// URL / header khi Google Script chuyển hướng. keep-alive giữ kết nối nên phần này không
+// bị cấp phát lại mỗi lần chấm công; sysmem_report() cho thấy heap thấp nhất thực tế.
+static esp_http_client_handle_t sheet_client = NULL;
+static uploader_result_cb_t on_result;
+
+// Gửi POST bằng client dùng chung
+static esp_err_t http_post(const char *url, const char *content_type, const char *data, size_t length)
+{
+    if (sheet_client == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Google Script chuyển hướng sang URL khác, nên đặt lại URL và phương thức mỗi lần gửi
+    esp_http_client_set_url(sheet_client, url);
+    esp_http_client_set_method(sheet_client, HTTP_METHOD_POST);
+    esp_http_client_set_header(sheet_client, "Content-Type", content_type);
+    // Thiết lập body request
+    esp_http_client_set_post_field(sheet_client, data, length);
+
+    // Gửi HTTP request
+    esp_err_t err = esp_http_client_perform(sheet_client);
+    if (err == ESP_OK) {
+        int status = esp_http_client_get_status_code(sheet_client);
+        if (status >= 500) {
+            // Máy nhận / shim chưa chuyển tiếp được: giữ bản ghi lại để gửi lại
+            ESP_LOGE(TAG, "Server error, status %d", status);
+            return ESP_FAIL;
+        }
+        if (status >= 400) {
+            // Gửi lại dữ liệu bị từ chối cũng không thành công, chỉ ghi log
+            ESP_LOGW(TAG, "Data rejected by server, status %d", status);
+        } else {
+            ESP_LOGI(TAG, "Data sent successfully, status %d", status);
+        }
+    } else {
+        ESP_LOGE(TAG, "Error sending data: %s", esp_err_to_name(err));
+        // Đóng kết nối lỗi, lần gửi sau sẽ kết nối lại với cùng client
+        esp_http_client_close(sheet_client);
+    }
+
+    return err;
+}
+
+#if !CONFIG_VANTAY_WIRE_FORMAT_BINARY
+// Hàm gửi dữ liệu đến Google Sheets
+static esp_err_t send_to_google_sheets(const char *post_data)
+{
+    return http_post(GOOGLE_SHEET_URL, "application/json", post_data, strlen(post_data));
+}
+#endif
+
+static esp_err_t http_start(uploader_result_cb_t result_cb) {
+    on_result = result_cb;
+    esp_http_client_config_t config = {
+        .url = UPLOAD_URL,
+        .method = HTTP_METHOD_POST,
+        .crt_bundle_attach = esp_crt_bundle_attach,
+        .buffer_size = CONFIG_VANTAY_HTTP_BUFFER_SIZE,
+        .buffer_size_tx = CONFIG_VANTAY_HTTP_BUFFER_SIZE,
+        .keep_alive_enable = true,
+    };
+    sheet_client = esp_http_client_init(&config);
+    if (sheet_client == NULL) {
+        ESP_LOGE(TAG, "Failed to initialize HTTP client");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static bool http_ready(void) {
+    return wifi_connect_status && sheet_client != NULL;
+}
+
+#if CONFIG_VANTAY_WIRE_FORMAT_BINARY
+// Bộ đệm mã hóa dùng lại giữa các lần gửi
+static uint8_t wire_buf[16 + UPLOADER_BATCH_MAX * RECORD_MAX_BYTES];
+
+// Cả lô trong một POST tới bộ nhận / shim: tới nơi cả lô hoặc không bản ghi nào
+static int http_send(const attendance_record_t *records, int count) {
+    size_t len = uploader_format_binary(records, count, wire_buf, sizeof(wire_buf));
+    if (len == 0) {
+        ESP_LOGE(TAG, "Failed to encode %d punch(es)", count);
+        return 0;
+    }
+    ESP_LOGI(TAG, "Sending %d punch(es) in %u bytes", count, (unsigned)len);
+    if (http_post(CONFIG_VANTAY_RECORD_RECEIVER_URL, "application/octet-stream", (const char *)wire_buf, len) != ESP_OK) {
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        on_result(records[i].seq, true);
+    }
+    return count;
+}
+#else
+// Mỗi bản ghi một POST JSON tới Google Sheets. Dừng ở bản ghi lỗi đầu tiên để các bản ghi
+// đã tới nơi không bị gửi lại, giữ thứ tự của phần còn lại.
+static int http_send(const attendance_record_t *records, int count) {
+    char post_data[256];
+    for (int i = 0; i < count; i++) {
+        if (uploader_format_json(&records[i], post_data, sizeof(post_data)) == 0) {
+            // Gửi lại cũng không định dạng được, bỏ như bản ghi bị server từ chối
+            ESP_LOGE(TAG, "Failed to format punch %lu, skipped", (unsigned long)records[i].seq);
+            on_result(records[i].seq, true);
+            continue;
+        }
+        ESP_LOGI(TAG, "Sending data: %s", post_data);
+        if (send_to_google_sheets(post_data) != ESP_OK) {
+            return i;
+        }
+        on_result(records[i].seq, true);
+    }
+    return count;
+}
+#endif
+
+#if CONFIG_VANTAY_WIRE_FORMAT_BINARY
+static uint8_t summary_buf[16 + AGG_SLOT_COUNT * SUMMARY_ENTRY_MAX_BYTES];
+
+static esp_err_t http_send_summary(uint32_t day, const attendance_summary_t *entries, int count) {
+    size_t len = uploader_format_summary_binary(day, entries, count, summary_buf, sizeof(summary_buf));
+    if (len == 0) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    ESP_LOGI(TAG, "Sending summary for %lu: %d row(s) in %u bytes", (unsigned long)day, count, (unsigned)len);
+    return http_post(CONFIG_VANTAY_RECORD_RECEIVER_URL, "application/octet-stream", (const char *)summary_buf, len);
+}
+#else
+static char summary_buf[1024];
+
+// Chia thành nhiều POST nếu bảng không vừa bộ đệm
+static esp_err_t http_send_summary(uint32_t day, const attendance_summary_t *entries, int count) {
+    int sent = 0;
+    do {
+        int consumed;
+        size_t len = uploader_format_summary_json(day, entries + sent, count - sent,
+                                                  summary_buf, sizeof(summary_buf), &consumed);
+        if (len == 0) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        ESP_LOGI(TAG, "Sending summary for %lu: %d row(s)", (unsigned long)day, consumed);
+        esp_err_t err = send_to_google_sheets(summary_buf);
+        if (err != ESP_OK) {
+            return err;
+        }
+        sent += consumed;
+    } while (sent < count);
+    return ESP_OK;
+}
+#endif
+
+const uploader_t uploader_http = {
+    .name = "http",
+    .start = http_start,
+    .ready = http_ready,
+    .send = http_send,
+    .send_summary = http_send_summary,
+};
@@ -0,0 +1,261 @@
+#include "uploader.h"
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "mqtt_client.h"
+#include "record_codec.h"
+#include "attendance_agg.h"
+#include "sysmem.h"
+
+#define TAG "UPLOADER_MQTT"
+
+#if !CONFIG_MQTT_REPORT_DELETED_MESSAGES
+#error "uploader_mqtt needs CONFIG_MQTT_REPORT_DELETED_MESSAGES to requeue expired punches"
+#endif
+
+#if CONFIG_VANTAY_WIRE_FORMAT_BINARY
+#define RECORDS_PER_MESSAGE UPLOADER_BATCH_MAX  // Cả lô trong một tin
+#else
+#define RECORDS_PER_MESSAGE 1                   // Mỗi bản ghi một tin JSON
+#endif
+#define RESULT_QUEUE_LEN (CONFIG_VANTAY_MQTT_WINDOW + 4)
+
+// Một tin QoS 1 đã vào outbox, chờ PUBACK. Tin tổng hợp có count = 0.
+typedef struct {
+    int msg_id;         // 0 = chỗ trống
+    int count;
+    uint32_t seq[RECORDS_PER_MESSAGE];
+} inflight_t;
+
+// Sự kiện của task MQTT, chuyển sang mqtt_poll() để chỉ task gửi đụng tới bảng inflight
+typedef struct {
+    int32_t event_id;
+    int msg_id;
+} mqtt_result_t;
+
+static esp_mqtt_client_handle_t client = NULL;
+static volatile bool connected = false;
+static uploader_result_cb_t on_result;
+// Cửa sổ gửi: tối đa CONFIG_VANTAY_MQTT_WINDOW tin chưa được xác nhận. Chỗ được trả khi broker
+// xác nhận (PUBACK), khi tin hết hạn trong outbox (DELETED, cần CONFIG_MQTT_REPORT_DELETED_MESSAGES
+// mà Kconfig chọn sẵn) hoặc khi mất kết nối. Chỉ task gửi truy cập.
+static inflight_t inflight[CONFIG_VANTAY_MQTT_WINDOW];
+static QueueHandle_t results;
+static volatile bool results_lost = false;     // Hàng đợi sự kiện tràn, không biết tin nào đã tới
+static char topic[48];
+static char summary_topic[48];
+
+static void post_result(int32_t event_id, int msg_id) {
+    mqtt_result_t result = { .event_id = event_id, .msg_id = msg_id };
+    if (xQueueSend(results, &result, 0) != pdTRUE) {
+        results_lost = true;
+    }
+}
+
+static void mqtt_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
+    esp_mqtt_event_handle_t event = event_data;
+    switch ((esp_mqtt_event_id_t)event_id) {
+    case MQTT_EVENT_CONNECTED:
+        connected = true;
+        ESP_LOGI(TAG, "Connected to broker (session present: %d)", event->session_present);
+        break;
+    case MQTT_EVENT_DISCONNECTED:
+        connected = false;
+        ESP_LOGW(TAG, "Disconnected from broker");
+        post_result(event_id, 0);
+        break;
+    case MQTT_EVENT_PUBLISHED:
+    case MQTT_EVENT_DELETED:
+        post_result(event_id, event->msg_id);
+        break;
+    case MQTT_EVENT_ERROR:
+        ESP_LOGE(TAG, "MQTT error");
+        break;
+    default:
+        break;
+    }
+}
+
+// Trả chỗ của một tin và báo kết quả từng bản ghi trong tin
+static void finish(inflight_t *msg, bool delivered) {
+    for (int i = 0; i < msg->count; i++) {
+        on_result(msg->seq[i], delivered);
+    }
+    msg->msg_id = 0;
+    msg->count = 0;
+}
+
+static void finish_msg(int msg_id, bool delivered) {
+    for (int i = 0; i < CONFIG_VANTAY_MQTT_WINDOW; i++) {
+        if (inflight[i].msg_id == msg_id) {
+            finish(&inflight[i], delivered);
+            return;
+        }
+    }
+    // Tin đã được trả chỗ lúc mất kết nối, outbox gửi lại sau khi kết nối lại
+}
+
+// Mất kết nối: mọi tin chưa có PUBACK được gửi lại từ hàng chờ của ứng dụng. Outbox có thể
+// vẫn gửi lại bản cũ (phiên bền), bên nhận bỏ trùng theo seq.
+static void finish_all(void) {
+    for (int i = 0; i < CONFIG_VANTAY_MQTT_WINDOW; i++) {
+        if (inflight[i].msg_id != 0) {
+            finish(&inflight[i], false);
+        }
+    }
+}
+
+static esp_err_t mqtt_start(uploader_result_cb_t result_cb) {
+    on_result = result_cb;
+    results = sysmem_queue_create(RESULT_QUEUE_LEN, sizeof(mqtt_result_t));
+    if (results == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    snprintf(topic, sizeof(topic), "vantay/%d/punch", CONFIG_VANTAY_DEVICE_ID);
+    snprintf(summary_topic, sizeof(summary_topic), "vantay/%d/summary", CONFIG_VANTAY_DEVICE_ID);
+
+    // Phiên bền (không clean session) để broker giữ trạng thái QoS 1 qua các lần mất kết nối
+    const esp_mqtt_client_config_t config = {
+        .broker.address.uri = CONFIG_VANTAY_MQTT_BROKER_URI,
+        .session.disable_clean_session = true,
+        .session.keepalive = 30,
+    };
+    client = esp_mqtt_client_init(&config);
+    if (client == NULL) {
+        return ESP_FAIL;
+    }
+    esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
+    return esp_mqtt_client_start(client);
+}
+
+static bool mqtt_ready(void) {
+    return connected;
+}
+
+// Xử lý PUBACK / hết hạn / mất kết nối đã nhận từ task MQTT
+static void mqtt_poll(void) {
+    mqtt_result_t result;
+    if (results == NULL) {
+        return;
+    }
+    while (xQueueReceive(results, &result, 0) == pdTRUE) {
+        switch (result.event_id) {
+        case MQTT_EVENT_PUBLISHED:
+            finish_msg(result.msg_id, true);
+            break;
+        case MQTT_EVENT_DELETED:
+            ESP_LOGW(TAG, "Message %d expired in outbox", result.msg_id);
+            finish_msg(result.msg_id, false);
+            break;
+        default:
+            finish_all();
+            break;
+        }
+    }
+    if (results_lost) {
+        results_lost = false;
+        ESP_LOGW(TAG, "Result queue overflowed, resending in-flight messages");
+        finish_all();
+    }
+}
+
+// Đưa một tin QoS 1 vào outbox nếu cửa sổ còn chỗ; không chờ. seq là các bản ghi trong tin.
+static esp_err_t publish(const char *to, const char *data, size_t len, const uint32_t *seq, int count) {
+    inflight_t *msg = NULL;
+    for (int i = 0; i < CONFIG_VANTAY_MQTT_WINDOW; i++) {
+        if (inflight[i].msg_id == 0) {
+            msg = &inflight[i];
+            break;
+        }
+    }
+    if (msg == NULL) {
+        return ESP_ERR_TIMEOUT;
+    }
+    // Không chặn: tác vụ MQTT gửi từ outbox, giữ kết nối duy nhất. PUBACK chỉ được xử lý
+    // trong mqtt_poll() của cùng task nên không thể đến trước khi tin được ghi vào bảng.
+    int msg_id = esp_mqtt_client_enqueue(client, to, data, len, 1, 0, true);
+    if (msg_id < 0) {
+        return ESP_FAIL;
+    }
+    msg->msg_id = msg_id;
+    msg->count = count;
+    if (count > 0) {
+        memcpy(msg->seq, seq, count * sizeof(uint32_t));
+    }
+    return ESP_OK;
+}
+
+#if CONFIG_VANTAY_WIRE_FORMAT_BINARY
+static uint8_t wire_buf[16 + UPLOADER_BATCH_MAX * RECORD_MAX_BYTES];
+
+// Cả lô trong một tin
+static int mqtt_send(const attendance_record_t *records, int count) {
+    uint32_t seq[UPLOADER_BATCH_MAX];
+    size_t len = uploader_format_binary(records, count, wire_buf, sizeof(wire_buf));
+    if (len == 0) {
+        ESP_LOGE(TAG, "Failed to encode %d punch(es)", count);
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        seq[i] = records[i].seq;
+    }
+    return publish(topic, (const char *)wire_buf, len, seq, count) == ESP_OK ? count : 0;
+}
+#else
+// Mỗi bản ghi một tin, tới khi cửa sổ đầy; phần còn lại được gửi ở lần gọi sau
+static int mqtt_send(const attendance_record_t *records, int count) {
+    char payload[160];
+    for (int i = 0; i < count; i++) {
+        size_t len = uploader_format_json(&records[i], payload, sizeof(payload));
+        if (len == 0) {
+            // Gửi lại cũng không định dạng được, bỏ
+            ESP_LOGE(TAG, "Failed to format punch %lu, skipped", (unsigned long)records[i].seq);
+            on_result(records[i].seq, true);
+            continue;
+        }
+        if (publish(topic, payload, len, &records[i].seq, 1) != ESP_OK) {
+            return i;
+        }
+    }
+    return count;
+}
+#endif
+
+#if CONFIG_VANTAY_WIRE_FORMAT_BINARY
+static uint8_t summary_buf[16 + AGG_SLOT_COUNT * SUMMARY_ENTRY_MAX_BYTES];
+
+static esp_err_t mqtt_send_summary(uint32_t day, const attendance_summary_t *entries, int count) {
+    size_t len = uploader_format_summary_binary(day, entries, count, summary_buf, sizeof(summary_buf));
+    if (len == 0) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return publish(summary_topic, (const char *)summary_buf, len, NULL, 0);
+}
+#else
+static char summary_buf[1024];
+
+static esp_err_t mqtt_send_summary(uint32_t day, const attendance_summary_t *entries, int count) {
+    int sent = 0;
+    do {
+        int consumed;
+        size_t len = uploader_format_summary_json(day, entries + sent, count - sent,
+                                                  summary_buf, sizeof(summary_buf), &consumed);
+        if (len == 0 || publish(summary_topic, summary_buf, len, NULL, 0) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        sent += consumed;
+    } while (sent < count);
+    return ESP_OK;
+}
+#endif
+
+const uploader_t uploader_mqtt = {
+    .name = "mqtt",
+    .start = mqtt_start,
+    .ready = mqtt_ready,
+    .send = mqtt_send,
+    .poll = mqtt_poll,
+    .send_summary = mqtt_send_summary,
+};
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
@@ -7,31 +8,68 @@
 #include "as608_driver.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
+#include "nvs.h"
 #include "time.h"
 #include "esp_sntp.h"
 #include "connectwifi.h"
 #include "esp_wifi.h"
-#include "esp_http_client.h"
-#include "esp_crt_bundle.h"
+#include "esp_timer.h"
 #include "oled.h"
+#include "sysmem.h"
+#include "input.h"
+#include "timekeep.h"
+#include "directory.h"
+#include "uploader.h"
+#include "sensor_health.h"
+#include "attendance_agg.h"
+#include "soak.h"
+#include "power.h"
+#if CONFIG_VANTAY_MGMT_API
+#include "mgmt_api.h"
+#endif
 
 #define TAG "ATTENDANCE_SYSTEM"
 #define OLED_TAG "OLED_DISPLAY"
-
-#define GOOGLE_SHEET_URL "https://script.google.com/macros/s/AKfycbw4HQ2KZkdjLaZnehB2p2fkW8hkoliwpv7bES5tl_1tUrOCP9p5SHh6K9-A5XreJvQ-tg/exec"
-
-// GPIO Definitions
-#define BUTTON_PIN GPIO_NUM_23   // Nút nhấn
-#define TOUCH_PIN GPIO_NUM_19   // Cảm biến chạm (WAK từ AS608)
-
-// Semaphore
-SemaphoreHandle_t button_semaphore;
-QueueHandle_t time_queue;
+#define NVS_NAMESPACE "vantay"
+#define NO_SLOT 0xFFFF          // Chưa có lần đăng ký nào để xóa
+
+#define PENDING_PUNCH_MAX CONFIG_VANTAY_PENDING_PUNCH_MAX   // Số lượt chấm công chờ gửi / chờ đồng bộ thời gian
+#define PUNCH_SEQ_BLOCK 64      // Số seq dành trước trong NVS mỗi lần ghi
+#define PUNCH_SAVE_DELAY_US (2 * 1000000LL)     // Chờ PUBACK trước khi lưu hàng chờ vào NVS
+
+// Một lượt chấm công; thời gian thực được tính lúc gửi để có thể đóng dấu lại sau SNTP
+typedef struct {
+    uint16_t id;
+    bool aggregated;    // Đã cộng vào bảng tổng hợp, không cộng lại khi gửi lại
+    bool stamped;       // Khôi phục từ NVS: mono_us của lần khởi động trước, dùng epoch đã lưu
+    bool in_flight;     // Backend đã nhận, chờ kết quả (PUBACK); không gửi lại trong lúc chờ
+    uint32_t seq;       // Bên nhận bỏ trùng theo seq khi một lượt bị gửi lại
+    int64_t mono_us;    // esp_timer_get_time() lúc chấm công
+    uint32_t epoch;     // Đóng dấu lúc lưu NVS, chỉ dùng khi stamped
+    uint32_t uncertainty_ms;
+} punch_t;
+
+// Hàng chờ chấm công. fingerprint_task chỉ thêm vào; mọi lần gửi mạng chạy trong time_sync_task,
+// punch_lock chỉ bảo vệ hàng chờ và không bao giờ được giữ trong lúc gửi. Một lượt chỉ rời hàng
+// chờ khi backend báo đã tới nơi, nên lượt đang chờ xác nhận vẫn được lưu NVS.
+// Hàng chờ được lưu NVS (punch_q) khi đã thay đổi quá PUNCH_SAVE_DELAY_US để không mất lượt
+// chấm công khi mất điện lúc đang mất mạng; lượt được xác nhận kịp trong lúc đó không ghi flash.
+static punch_t pending_punches[PENDING_PUNCH_MAX];
+static int pending_count = 0;
+static uint32_t punches_dropped = 0;    // Bỏ vì hàng chờ đầy khi mất mạng / gửi lỗi kéo dài, lưu NVS
+static bool queue_dirty = false;        // Hàng chờ / số lượt bỏ đã đổi từ lần lưu NVS trước
+static int64_t dirty_since_us = 0;      // Lần thay đổi đầu tiên chưa được lưu
+static int saved_count = 0;             // Số lượt trong bản lưu NVS gần nhất
+static SemaphoreHandle_t punch_lock;
+// seq tăng dần qua các lần khởi động: NVS giữ cận trên của các seq đã cấp, dành trước từng khối
+// PUNCH_SEQ_BLOCK để không ghi flash mỗi lượt. Khởi động lại bỏ qua phần còn lại của khối.
+static uint32_t next_seq = 0;
+static uint32_t seq_reserved = 0;
 
 //static char current_time[64];    // Chuỗi lưu thời gian thực
-bool fingerprint_verified = false; 
+// Chỉ fingerprint_task ghi, time_sync_task đọc để biết có được vẽ đồng hồ hay không
+volatile bool fingerprint_verified = false;
 
-esp_err_t send_to_google_sheets(const char *data);
 void time_sync_callback(struct timeval *tv);
 
 
@@ -39,119 +77,553 @@ void time_sync_callback(struct timeval *tv);
 typedef enum {
     IDLE,   // 
     ENROLL,  // Chế độ lưu trữ vân tay
-    VERIFYING
+    VERIFYING,
+    DELETING, // Xóa vân tay vừa đăng ký
+    ENROLL_QUEUED // Chạy các phiên đăng ký xếp hàng qua API
 } fingerprint_state_t;
 
+#if CONFIG_VANTAY_MGMT_API
+#define FINGERPRINT_EVT_ALL (INPUT_EVT_ALL | MGMT_EVT_SESSION)
+#else
+#define FINGERPRINT_EVT_ALL INPUT_EVT_ALL
+#endif
+
+// Chỉ fingerprint_task đọc/ghi; ISR gửi sự kiện qua task notification
 static fingerprint_state_t system_state = IDLE;
 
-// Vị trí lưu vân tay hiện tại
-static uint16_t fingerprint_position = 0;
+// Vị trí của lần đăng ký tại chỗ gần nhất, nhấn đúp sẽ xóa vị trí này. Lưu NVS để còn sau khi
+// khởi động lại. API xóa mẫu (task của httpd) có thể đặt lại về NO_SLOT.
+static volatile uint16_t last_enrolled_slot = NO_SLOT;
+
+// Backend gửi dữ liệu (HTTP hoặc MQTT)
+static const uploader_t *uploader;
+
+static void load_punch_seq(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return;
+    }
+    nvs_get_u32(nvs, "punch_seq", &seq_reserved);
+    nvs_close(nvs);
+    next_seq = seq_reserved;
+}
+
+// Khôi phục hàng chờ đã lưu. Thời gian của lần khởi động trước chỉ còn epoch đã đóng dấu lúc lưu.
+static void load_pending_punches(void)
+{
+    nvs_handle_t nvs;
+    size_t len = sizeof(pending_punches);
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return;
+    }
+    if (nvs_get_blob(nvs, "punch_q", pending_punches, &len) == ESP_OK && len % sizeof(punch_t) == 0) {
+        pending_count = len / sizeof(punch_t);
+    }
+    nvs_get_u32(nvs, "punch_drop", &punches_dropped);
+    nvs_close(nvs);
+
+    for (int i = 0; i < pending_count; i++) {
+        pending_punches[i].stamped = true;
+        pending_punches[i].in_flight = false;
+    }
+    saved_count = pending_count;
+    if (pending_count > 0 || punches_dropped > 0) {
+        ESP_LOGW(TAG, "Restored %d pending punch(es), %lu dropped since first boot",
+                 pending_count, (unsigned long)punches_dropped);
+    }
+}
+
+// Gọi khi giữ punch_lock
+static void mark_queue_dirty(void)
+{
+    if (!queue_dirty) {
+        queue_dirty = true;
+        dirty_since_us = esp_timer_get_time();
+    }
+}
+
+// Lưu hàng chờ nếu đã thay đổi. Gọi mỗi giây từ time_sync_task, sau khi gửi.
+static void checkpoint_pending_punches(void)
+{
+    nvs_handle_t nvs;
+
+    xSemaphoreTake(punch_lock, portMAX_DELAY);
+    // Hàng chờ vẫn rỗng như bản đã lưu: lượt chấm công đã tới nơi, không ghi flash
+    if (!queue_dirty || (pending_count == 0 && saved_count == 0)) {
+        queue_dirty = false;
+        xSemaphoreGive(punch_lock);
+        return;
+    }
+    // Lượt vừa gửi qua MQTT thường được xác nhận ở giây sau, chờ thay vì lưu rồi xóa ngay
+    if (esp_timer_get_time() - dirty_since_us < PUNCH_SAVE_DELAY_US) {
+        xSemaphoreGive(punch_lock);
+        return;
+    }
+    // Đóng dấu thời gian tốt nhất hiện có để dùng nếu khởi động lại trước khi gửi được;
+    // mono_us vẫn giữ nên lần gửi trong lần chạy này vẫn đóng dấu lại được
+    for (int i = 0; i < pending_count; i++) {
+        if (!pending_punches[i].stamped) {
+            time_t epoch;
+            timekeep_stamp(pending_punches[i].mono_us, &epoch, &pending_punches[i].uncertainty_ms);
+            pending_punches[i].epoch = (uint32_t)epoch;
+        }
+    }
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK) {
+        if (pending_count > 0) {
+            nvs_set_blob(nvs, "punch_q", pending_punches, pending_count * sizeof(punch_t));
+        } else {
+            nvs_erase_key(nvs, "punch_q");
+        }
+        nvs_set_u32(nvs, "punch_drop", punches_dropped);
+        nvs_commit(nvs);
+        nvs_close(nvs);
+        saved_count = pending_count;
+        queue_dirty = false;
+    } else {
+        ESP_LOGE(TAG, "Failed to open NVS namespace %s", NVS_NAMESPACE);
+    }
+    xSemaphoreGive(punch_lock);
+}
+
+// Cấp seq cho một lượt chấm công mới, gọi khi giữ punch_lock
+static uint32_t allocate_punch_seq(void)
+{
+    if (next_seq == seq_reserved) {
+        nvs_handle_t nvs;
+        seq_reserved = next_seq + PUNCH_SEQ_BLOCK;
+        if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK) {
+            nvs_set_u32(nvs, "punch_seq", seq_reserved);
+            nvs_commit(nvs);
+            nvs_close(nvs);
+        } else {
+            ESP_LOGE(TAG, "Failed to open NVS namespace %s", NVS_NAMESPACE);
+        }
+    }
+    return next_seq++;
+}
 
-// ISR: Xử lý nút nhấn
-void IRAM_ATTR button_isr_handler(void *arg) {
-    if (system_state == IDLE) {
-        system_state = ENROLL;  // Chuyển sang chế độ lưu trữ
-        xSemaphoreGiveFromISR(button_semaphore, NULL);
+// Kết quả gửi của một lượt (on_result của backend): tới nơi thì bỏ khỏi hàng chờ, lỗi thì
+// để lần flush sau gửi lại. Lượt đã bị bỏ vì hàng chờ đầy thì không còn để tìm thấy.
+static void punch_result(uint32_t seq, bool delivered)
+{
+    xSemaphoreTake(punch_lock, portMAX_DELAY);
+    for (int i = 0; i < pending_count; i++) {
+        if (pending_punches[i].seq != seq) {
+            continue;
+        }
+        if (delivered) {
+            pending_count--;
+            memmove(&pending_punches[i], &pending_punches[i + 1], (pending_count - i) * sizeof(punch_t));
+            mark_queue_dirty();
+        } else {
+            // in_flight không được lưu, không cần ghi lại NVS mỗi lần gửi lỗi
+            pending_punches[i].in_flight = false;
+        }
+        break;
     }
+    xSemaphoreGive(punch_lock);
 }
 
-// Cấu hình GPIO
-static void gpio_config_init() {
-    // Cấu hình nút nhấn
-    gpio_config_t button_config = {
-        .pin_bit_mask = (1ULL << BUTTON_PIN),
-        .mode = GPIO_MODE_INPUT,
-        .pull_up_en = GPIO_PULLUP_ENABLE,
-        .intr_type = GPIO_INTR_NEGEDGE, // Kích hoạt ngắt khi nhấn
+#if !CONFIG_VANTAY_AGG_RAW_ONLY
+#define SUMMARY_RETRY_MIN_S 30     // Chờ lần đầu trước khi gửi lại ngày đã đóng
+#define SUMMARY_RETRY_MAX_S 3600   // Trần của backoff
+
+// Gửi tổng hợp của ngày đã đóng (nếu còn) và bản chụp của ngày hiện tại.
+// Gửi ngoài mọi lock; trả về false nếu có bảng gửi lỗi.
+static bool upload_summaries(bool include_current)
+{
+    uint32_t day;
+    const attendance_summary_t *entries;
+    int count;
+    bool ok = true;
+
+    if (agg_has_closed_day()) {
+        count = agg_snapshot(true, &day, &entries);
+        if (count == 0 || uploader->send_summary(day, entries, count) == ESP_OK) {
+            agg_closed_day_sent(day);
+        } else {
+            ESP_LOGE(TAG, "Failed to upload closed day %lu", (unsigned long)day);
+            ok = false;
+        }
+    }
+    if (include_current) {
+        count = agg_snapshot(false, &day, &entries);
+        if (count > 0 && uploader->send_summary(day, entries, count) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to upload summary for %lu", (unsigned long)day);
+            ok = false;
+        }
+    }
+    return ok;
+}
+#endif
+
+// Có thể xử lý lượt chấm công ngay: thời gian tin cậy và (nếu gửi từng lượt) có mạng
+static bool punch_path_ready(void)
+{
+#if CONFIG_VANTAY_AGG_SUMMARY_ONLY
+    return timekeep_is_trusted();
+#else
+    return timekeep_is_trusted() && uploader->ready();
+#endif
+}
+
+// Ghi nhận chấm công: chỉ đưa vào hàng chờ, time_sync_task gửi trong vòng một giây.
+// fingerprint_task không bao giờ chờ mạng. Trả về seq của lượt chấm công.
+static uint32_t submit_punch(uint16_t id)
+{
+    punch_t punch = {
+        .id = id,
+        .mono_us = esp_timer_get_time(),
+        .aggregated = false,
+        .stamped = false,
+        .in_flight = false,
     };
-    gpio_config(&button_config);
-
-    // Cấu hình cảm biến chạm
-    gpio_config_t touch_config = {
-        .pin_bit_mask = (1ULL << TOUCH_PIN),
-        .mode = GPIO_MODE_INPUT,
-        .pull_up_en = GPIO_PULLUP_DISABLE,
-        .intr_type = GPIO_INTR_DISABLE, // Không cần ngắt
+    bool dropped = false;
+
+    xSemaphoreTake(punch_lock, portMAX_DELAY);
+    punch.seq = allocate_punch_seq();
+    if (pending_count == PENDING_PUNCH_MAX) {
+        // Hết chỗ (mất mạng / chưa có giờ quá lâu): bỏ lượt cũ nhất, không gửi khi chưa có mạng
+        memmove(&pending_punches[0], &pending_punches[1], (PENDING_PUNCH_MAX - 1) * sizeof(punch_t));
+        pending_count--;
+        punches_dropped++;
+        dropped = true;
+    }
+    pending_punches[pending_count++] = punch;
+    mark_queue_dirty();
+    xSemaphoreGive(punch_lock);
+
+    if (dropped) {
+        ESP_LOGE(TAG, "Pending queue full, dropped oldest punch (%lu in total)", (unsigned long)punches_dropped);
+    }
+    return punch.seq;
+}
+
+// Hàng chờ đầy, có mạng nhưng chưa có giờ tin cậy: gửi với thời gian ước lượng thay vì
+// để lượt mới đẩy lượt cũ ra. Chế độ chỉ tổng hợp không cộng giờ ước lượng vào bảng ngày.
+static bool pending_overflowing(void)
+{
+#if CONFIG_VANTAY_AGG_SUMMARY_ONLY
+    return false;
+#else
+    xSemaphoreTake(punch_lock, portMAX_DELAY);
+    bool full = pending_count == PENDING_PUNCH_MAX;
+    xSemaphoreGive(punch_lock);
+    return full && uploader->ready();
+#endif
+}
+
+// Đóng dấu thời gian tốt nhất hiện có cho tối đa một lô lượt chấm công cũ nhất chưa gửi và gửi
+// qua backend. Mỗi lần gọi (mỗi giây) một lô để không giữ time_sync_task lâu khi hàng chờ dài;
+// backend không chờ cửa sổ gửi, phần nó chưa nhận được gửi lại ở lần gọi sau.
+static void flush_pending_punches(void)
+{
+    attendance_record_t records[UPLOADER_BATCH_MAX];
+    int count = 0;
+    time_t epoch;
+
+    xSemaphoreTake(punch_lock, portMAX_DELAY);
+    for (int i = 0; i < pending_count && count < UPLOADER_BATCH_MAX; i++) {
+        punch_t *punch = &pending_punches[i];
+        if (punch->in_flight) {
+            continue;
+        }
+        attendance_record_t *record = &records[count++];
+        record->slot = punch->id;
+        record->seq = punch->seq;
+        if (punch->stamped) {
+            record->epoch = punch->epoch;
+            record->uncertainty_ms = punch->uncertainty_ms;
+        } else {
+            timekeep_stamp(punch->mono_us, &epoch, &record->uncertainty_ms);
+            record->epoch = (uint32_t)epoch;
+        }
+#if !CONFIG_VANTAY_AGG_RAW_ONLY
+        // Cộng vào bảng tổng hợp ngày trên thiết bị, một lần cho mỗi lượt
+        if (!punch->aggregated) {
+            agg_add(record->slot, record->epoch);
+            punch->aggregated = true;
+            mark_queue_dirty();
+        }
+#endif
+        punch->in_flight = true;
+    }
+    xSemaphoreGive(punch_lock);
+
+    if (count == 0) {
+        return;
+    }
+#if CONFIG_VANTAY_AGG_SUMMARY_ONLY
+    // Chỉ gửi tổng hợp: lượt chấm công đã vào bảng ngày thì xong
+    for (int i = 0; i < count; i++) {
+        punch_result(records[i].seq, true);
+    }
+#else
+    int accepted = uploader->send(records, count);
+    if (accepted < count) {
+        ESP_LOGW(TAG, "%s took %d of %d punch(es), will retry the rest", uploader->name, accepted, count);
+        for (int i = accepted; i < count; i++) {
+            punch_result(records[i].seq, false);
+        }
+    }
+#endif
+}
+
+#if CONFIG_VANTAY_SOAK_TEST || CONFIG_VANTAY_MEM_REPORT_INTERVAL_S > 0
+static int pending_punch_count(void)
+{
+    xSemaphoreTake(punch_lock, portMAX_DELAY);
+    int count = pending_count;
+    xSemaphoreGive(punch_lock);
+    return count;
+}
+
+static uint32_t dropped_punch_count(void)
+{
+    return punches_dropped;
+}
+#endif
+
+#if CONFIG_VANTAY_SOAK_TEST
+static const soak_target_t soak_target = {
+    .submit = submit_punch,
+    .pending = pending_punch_count,
+    .dropped = dropped_punch_count,
+};
+#endif
+
+// Lời nhắc của driver trong lúc đăng ký
+static void enroll_prompt(as608_prompt_t prompt)
+{
+    static const char *const text[] = {
+        [AS608_PROMPT_PLACE] = "PLACE FINGER",
+        [AS608_PROMPT_REMOVE] = "REMOVE FINGER",
+        [AS608_PROMPT_PLACE_AGAIN] = "PLACE AGAIN",
     };
-    gpio_config(&touch_config);
+    draw_message(text[prompt]);
+}
+
+static void load_last_enrolled(void)
+{
+    nvs_handle_t nvs;
+    uint16_t slot = NO_SLOT;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return;
+    }
+    nvs_get_u16(nvs, "last_slot", &slot);
+    nvs_close(nvs);
+    last_enrolled_slot = slot;
+}
+
+static void save_last_enrolled(uint16_t slot)
+{
+    nvs_handle_t nvs;
+    last_enrolled_slot = slot;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS namespace %s", NVS_NAMESPACE);
+        return;
+    }
+    nvs_set_u16(nvs, "last_slot", slot);
+    nvs_commit(nvs);
+    nvs_close(nvs);
+}
+
+#if CONFIG_VANTAY_MGMT_API
+// Mẫu bị xóa qua API (task của httpd): quên lần đăng ký gần nhất nếu nó nằm trong số bị xóa,
+// để nút xóa không xóa nhầm người được đăng ký lại vào slot đó sau này
+static void templates_deleted(uint16_t slot)
+{
+    uint16_t last = last_enrolled_slot;
+    if (last != NO_SLOT && (slot == MGMT_ALL_SLOTS || slot == last)) {
+        ESP_LOGI(TAG, "Last enrolled position %d deleted via API, forgetting it", last);
+        save_last_enrolled(NO_SLOT);
+    }
+}
+#endif
 
-    // Đăng ký ISR cho nút nhấn
-    gpio_install_isr_service(0);
-    gpio_isr_handler_add(BUTTON_PIN, button_isr_handler, NULL);
+// Vị trí trống đầu tiên trong thư viện của cảm biến; NO_SLOT nếu đầy hoặc không đọc được
+static uint16_t next_free_slot(void)
+{
+    uint8_t bitmap[AS608_LIBRARY_SIZE / 8];
+    if (!as608_read_index_table(bitmap)) {
+        return NO_SLOT;
+    }
+    for (uint16_t slot = 0; slot < AS608_LIBRARY_SIZE; slot++) {
+        if (!(bitmap[slot / 8] & (1 << (slot % 8)))) {
+            return slot;
+        }
+    }
+    return NO_SLOT;
+}
+
+// Một lần đăng ký vào slot, hiển thị kết quả. Không ghi đè mẫu đã có trừ khi overwrite
+// (slot có thể đã được đăng ký trong lúc phiên chờ trong hàng). remember: ghi slot làm lần
+// đăng ký gần nhất cho nút xóa; chỉ dùng cho đăng ký tại chỗ, phiên qua API không ghi.
+static bool enroll_slot(uint16_t slot, bool overwrite, bool remember)
+{
+    uint8_t bitmap[AS608_LIBRARY_SIZE / 8];
+    if (!overwrite && (!as608_read_index_table(bitmap) || (bitmap[slot / 8] & (1 << (slot % 8))))) {
+        draw_fail();
+        ESP_LOGE(TAG, "Position %d is already enrolled or the index is unreadable, not overwriting.", slot);
+        vTaskDelay(pdMS_TO_TICKS(1000));
+        return false;
+    }
+    bool ok = as608_enroll_fingerprint(slot, enroll_prompt);
+    if (ok) {
+        draw_success();
+        ESP_LOGI(TAG, "Fingerprint enrolled successfully at position %d!", slot);
+        if (remember) {
+            save_last_enrolled(slot);
+        }
+    } else {
+        draw_fail();
+        ESP_LOGE(TAG, "Failed to enroll fingerprint at position %d.", slot);
+    }
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    return ok;
 }
 
 // Task chính quản lý vân tay
 void fingerprint_task(void *arg) {
     uint16_t matched_id = 0;
     uint16_t score = 0;
-    char time_to_send[64];
+    uint32_t events = 0;
+    uint32_t handled = 0;
     while (1) {
+        // Chờ sự kiện từ lớp input thay vì thăm dò chân chạm mỗi 100 ms
+        xTaskNotifyWait(0, FINGERPRINT_EVT_ALL, &events, portMAX_DELAY);
+#if CONFIG_VANTAY_MGMT_API
+        if (events & MGMT_EVT_SESSION) {
+            system_state = ENROLL_QUEUED;
+            handled = MGMT_EVT_SESSION;
+        } else
+#endif
+        if (events & INPUT_EVT_LONG_PRESS) {
+            system_state = ENROLL;
+            handled = INPUT_EVT_LONG_PRESS;
+        } else if (events & INPUT_EVT_DOUBLE_PRESS) {
+            system_state = DELETING;
+            handled = INPUT_EVT_DOUBLE_PRESS;
+        } else if (events & (INPUT_EVT_TOUCH | INPUT_EVT_SHORT_PRESS)) {
+            system_state = VERIFYING;
+            handled = INPUT_EVT_TOUCH | INPUT_EVT_SHORT_PRESS;
+        } else {
+            continue;
+        }
+        power_activity();
+
         switch (system_state) {
-        case ENROLL:
-            // Thực hiện lưu trữ vân tay
+        case ENROLL: {
+            // Đăng ký tại chỗ vào vị trí trống đầu tiên
+            input_touch_disarm();
             fingerprint_verified = true;
             ESP_LOGI(TAG, "Starting fingerprint enrollment...");
-            vTaskDelay(pdMS_TO_TICKS(3000));
-
-            if (fingerprint_position > 175) {
-                fingerprint_position = 0;
-            }
-
-            if (!as608_enroll_fingerprint(fingerprint_position)) {
+            uint16_t slot = next_free_slot();
+            if (slot == NO_SLOT) {
+                ESP_LOGE(TAG, "No free slot in the fingerprint library.");
                 draw_fail();
-                ESP_LOGE(TAG, "Failed to enroll fingerprint.");
-            } else {
-                draw_success();
-                ESP_LOGI(TAG, "Fingerprint enrolled successfully at position %d!", fingerprint_position);
-                fingerprint_position++;
+                vTaskDelay(pdMS_TO_TICKS(2000));
+                break;
             }
+            enroll_slot(slot, false, true);
+            break;
+        }
 
-            // Trì hoãn để tránh kích hoạt chế độ xác thực ngay lập tức
-            ESP_LOGI(TAG, "Enrollment complete. Please remove your finger.");
-            vTaskDelay(pdMS_TO_TICKS(3000)); // Chờ người dùng nhấc tay
-
-            // Quay lại chế độ chờ
-            system_state = IDLE;
-            fingerprint_verified = false;
+        case ENROLL_QUEUED: {
+#if CONFIG_VANTAY_MGMT_API
+            // Chạy liên tiếp các phiên đang chờ; chỉ chờ người đặt / nhấc ngón tay
+            mgmt_session_t session;
+            char label[24];
+            input_touch_disarm();
+            fingerprint_verified = true;
+            while (mgmt_api_next_session(&session)) {
+                const directory_employee_t *employee = directory_lookup(session.slot);
+                if (employee != NULL) {
+                    draw_message(employee->name);
+                } else {
+                    snprintf(label, sizeof(label), "SLOT %d", session.slot);
+                    draw_message(label);
+                }
+                ESP_LOGI(TAG, "Enrollment session %lu: slot %d %s", (unsigned long)session.id,
+                         session.slot, session.code);
+                vTaskDelay(pdMS_TO_TICKS(1500));
+                mgmt_api_session_done(session.id, enroll_slot(session.slot, session.overwrite, false));
+            }
+#endif
             break;
+        }
 
-        case IDLE:
-            // Chế độ xác thực vân tay
-            if (gpio_get_level(TOUCH_PIN) == 1) { // Kiểm tra tín hiệu cảm biến chạm
-                system_state = VERIFYING;
+        case DELETING: {
+            // Chỉ xóa đúng lần đăng ký gần nhất, một lần; không lùi sang vị trí của người khác
+            uint16_t slot = last_enrolled_slot;
+            fingerprint_verified = true;
+            if (slot == NO_SLOT) {
+                ESP_LOGW(TAG, "No enrolled fingerprint to delete.");
+                draw_fail();
+            } else if (as608_delete_fingerprint(slot, 1)) {
+                ESP_LOGI(TAG, "Deleted fingerprint at position %d", slot);
+                save_last_enrolled(NO_SLOT);
+                draw_success();
+            } else {
+                draw_fail();
             }
+            vTaskDelay(pdMS_TO_TICKS(2000));
             break;
+        }
 
-        case VERIFYING:
+        case VERIFYING: {
+            // Chạm cảm biến: ngón tay đã đặt sẵn, chụp ảnh ngay rồi mới vẽ màn hình
+            bool touched = (events & INPUT_EVT_TOUCH) != 0;
             fingerprint_verified = true;
             ESP_LOGI(TAG, "Detected touch. Verifying fingerprint...");
-            draw_verifying();
-            if (as608_verify_fingerprint(&matched_id, &score)) {
+            if (!touched) {
+                draw_verifying();
+            }
+            bool verified = as608_verify_fingerprint(&matched_id, &score, touched);
+            if (touched) {
+                power_record_wake_latency(input_last_touch_us(), as608_last_capture_us());
+            }
+            if (verified) {
                 draw_success();
                 ESP_LOGI(TAG, "Access granted! Matched ID: %d, Score: %d", matched_id, score);
-                if (xQueueReceive(time_queue, &time_to_send, pdMS_TO_TICKS(100)) == pdTRUE) {
-                    ESP_LOGI(TAG, "Received time: %s", time_to_send);
-                }
-                    
-                if (strcmp(time_to_send, "1970-01-01 07:00:03") != 0) {
-                    char post_data[256];
-                    snprintf(post_data, sizeof(post_data), "{\"ID\": \"%d\", \"Time\": \"%s\"}", matched_id, time_to_send);
-                    ESP_LOGI(TAG, "Sending data: %s", post_data);
-                    send_to_google_sheets(post_data);
+                submit_punch(matched_id);
+                // Tên nhân viên đọc thẳng từ flash, không sao chép
+                const directory_employee_t *employee = directory_lookup(matched_id);
+                if (employee != NULL) {
+                    ESP_LOGI(TAG, "Employee %.12s", employee->code);
+                    vTaskDelay(pdMS_TO_TICKS(1000));
+                    draw_message(employee->name);
                 }
+            } else if (as608_get_quality_hint() != FP_HINT_OK) {
+                // Ảnh chưa đạt: hiện gợi ý và cho thử lại ngay, bỏ qua thời gian chờ
+                draw_message(fp_quality_hint_str(as608_get_quality_hint()));
+                vTaskDelay(pdMS_TO_TICKS(1000));
+                break;
             } else {
                 ESP_LOGW(TAG, "Access denied! Fingerprint not found.");
                 draw_fail();
                 vTaskDelay(pdMS_TO_TICKS(2000));
             }
-            fingerprint_verified = false;
-            system_state = IDLE;
             vTaskDelay(pdMS_TO_TICKS(3000));
             break;
         }
 
-        // Thêm độ trễ nhỏ để tránh task chiếm CPU
-        vTaskDelay(pdMS_TO_TICKS(100));
+        case IDLE:
+            break;
+        }
+
+        // Quay lại chế độ chờ và nhận lần chạm mới
+        fingerprint_verified = false;
+        system_state = IDLE;
+        input_touch_rearm();
+
+        // Nút nhấn đến cùng lần báo (ví dụ cùng lúc có phiên từ API) chưa xử lý: tự báo lại để
+        // vòng sau xử lý. Lần chạm cũ thì bỏ như input_touch_rearm(), ngón tay đã nhấc ra.
+        uint32_t rest = events & ~handled & ~INPUT_EVT_TOUCH;
+        if (rest != 0) {
+            xTaskNotify(xTaskGetCurrentTaskHandle(), rest, eSetBits);
+        }
     }
 }
 
@@ -170,19 +642,21 @@ void time_sync_callback(struct timeval *tv)
     struct tm timeinfo;
     char strftime_buf[64];
     // Chuyển đổi thời gian
+    timekeep_on_sync(tv);
     localtime_r(&tv->tv_sec, &timeinfo);
-    timeinfo.tm_hour += 7;
     // Định dạng thời gian
     strftime(strftime_buf, sizeof(strftime_buf), "%Y-%m-%d %H:%M:%S", &timeinfo);
     ESP_LOGI(TAG, "Time synchronized: %s", strftime_buf);
 }
 
 void time_sync_task(void *arg) {
-    // Thiết lập múi giờ Việt Nam
-    setenv("TZ", "UTC-7", 1);  // GMT+7
-    tzset();                   // Áp dụng múi giờ
     char current_date[32]; // Biến lưu ngày (YYYY-MM-DD)
     char time[32]; // Biến lưu thời gian (HH:MM:SS)
+    uint32_t seconds_since_report = 0;
+    uint32_t seconds_since_summary = 0;
+    uint32_t seconds_since_checkpoint = 0;
+    uint32_t seconds_since_retry = 0;
+    uint32_t summary_retry_s = 0;   // Backoff gửi lại ngày đã đóng, nhân đôi mỗi lần lỗi
 
     while (1) {
         // Lấy thời gian thực
@@ -192,58 +666,78 @@ void time_sync_task(void *arg) {
         localtime_r(&tv.tv_sec, &timeinfo);
 
         // Định dạng thời gian
-        char strftime_buf[64];
-        strftime(strftime_buf, sizeof(strftime_buf), "%Y-%m-%d %H:%M:%S", &timeinfo);
         strftime(current_date, sizeof(current_date), "%Y-%m-%d", &timeinfo);
         strftime(time, sizeof(time), "%H:%M:%S", &timeinfo);
 
-        // Cập nhật thời gian thực an toàn qua Mutex
-        if (xQueueSend(time_queue, &strftime_buf, pdMS_TO_TICKS(100)) != pdTRUE) {
-            ESP_LOGW(TAG, "Failed to send time to queue");
+        // Lưu mốc thời gian vào RTC/NVS, gửi các lượt chấm công chờ khi thời gian đã tin cậy
+        timekeep_checkpoint();
+        if (uploader->poll != NULL) {
+            uploader->poll();
         }
+        if (punch_path_ready() || pending_overflowing()) {
+            flush_pending_punches();
+        }
+        checkpoint_pending_punches();
+
+#if !CONFIG_VANTAY_AGG_RAW_ONLY
+        // Tổng hợp ngày: chuyển ngày lúc nửa đêm, lưu NVS theo chu kỳ (ngay khi đóng/gửi xong
+        // một ngày), gửi theo lịch; ngày đã đóng gửi lỗi thì thử lại với backoff
+        seconds_since_summary++;
+        seconds_since_checkpoint++;
+        seconds_since_retry++;
+        if (timekeep_is_trusted()) {
+            agg_tick(tv.tv_sec);
+        }
+        if (seconds_since_checkpoint >= CONFIG_VANTAY_AGG_CHECKPOINT_MIN * 60 || agg_closed_day_unsaved()) {
+            agg_checkpoint();
+            seconds_since_checkpoint = 0;
+        }
+        if (uploader->ready()) {
+            bool due = seconds_since_summary >= CONFIG_VANTAY_AGG_UPLOAD_INTERVAL_MIN * 60;
+            bool retry = agg_has_closed_day() && seconds_since_retry >= summary_retry_s;
+            if (due || retry) {
+                if (upload_summaries(due)) {
+                    summary_retry_s = 0;
+                } else {
+                    summary_retry_s = summary_retry_s == 0 ? SUMMARY_RETRY_MIN_S : summary_retry_s * 2;
+                    if (summary_retry_s > SUMMARY_RETRY_MAX_S) {
+                        summary_retry_s = SUMMARY_RETRY_MAX_S;
+                    }
+                    ESP_LOGW(TAG, "Retrying summary upload in %lu s", (unsigned long)summary_retry_s);
+                }
+                seconds_since_retry = 0;
+            }
+            if (due) {
+                seconds_since_summary = 0;
+            }
+        }
+#endif
 
         // Hiển thị thời gian lên OLED nếu không xác thực vân tay
-        if (!fingerprint_verified) {
+        // Màn hình đã tắt khi rảnh (chế độ tiết kiệm điện) thì không vẽ, không đánh thức I2C
+        power_tick();
+        if (!fingerprint_verified && power_display_on()) {
             //oled_display_time(current_time);
         ESP_LOGI(OLED_TAG, "Current date displayed on OLED: %s", current_date);
         ESP_LOGI(OLED_TAG, "Current time displayed on OLED: %s", time);
         draw_time(time);
         }
 
+#if CONFIG_VANTAY_MEM_REPORT_INTERVAL_S > 0
+        if (++seconds_since_report >= CONFIG_VANTAY_MEM_REPORT_INTERVAL_S) {
+            seconds_since_report = 0;
+            sysmem_report();
+            power_report();
+            ESP_LOGI(TAG, "Punch queue: %d pending, %lu dropped", pending_punch_count(),
+                     (unsigned long)dropped_punch_count());
+        }
+#endif
+
         vTaskDelay(pdMS_TO_TICKS(1000));
     }
     vTaskDelay(pdMS_TO_TICKS(50));
 }
 
-// Hàm gửi dữ liệu đến Google Sheets
-esp_err_t send_to_google_sheets(const char *post_data)
-{
-    esp_http_client_config_t config = {
-        .url = GOOGLE_SHEET_URL,
-        .method = HTTP_METHOD_POST,
-        .crt_bundle_attach = esp_crt_bundle_attach,
-    };
-
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    esp_http_client_set_header(client, "Content-Type", "application/json");
-    // Thiết lập body request
-    esp_http_client_set_post_field(client, post_data, strlen(post_data));
-
-    // Gửi HTTP request
-    esp_err_t err = esp_http_client_perform(client);
-    if (err == ESP_OK) {
-        ESP_LOGI(TAG, "Data sent to Google Sheets successfully");
-    } else {
-        ESP_LOGE(TAG, "Error sending data to Google Sheets: %s", esp_err_to_name(err));
-    }
-
-    // Giải phóng tài nguyên
-    esp_http_client_cleanup(client);
-
-    return err;
-}
-
-
 // Hàm chính
 void app_main(void) {
     // Khởi tạo cảm biến AS608
@@ -253,33 +747,66 @@ void app_main(void) {
         ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
+    // Khôi phục thời gian từ RTC/NVS trước mọi thứ khác, không phụ thuộc mạng
+    timekeep_init();
+    agg_init();
+    load_last_enrolled();
+    load_punch_seq();
+    // Danh bạ có thể trống, khi đó chỉ hiển thị ID vân tay
+    directory_init();
+    // Light sleep tự động (nếu bật); khóa nguồn của các driver được tạo sau đó
+    if (!power_init()) {
+        ESP_LOGE(TAG, "Failed to configure power management.");
+    }
+    // Cảm biến lỗi lúc khởi động không dừng hệ thống, task giám sát sẽ khôi phục
     if (!as608_init()) {
         ESP_LOGE(TAG, "Failed to initialize AS608.");
-        return;
+    }
+    if (!sensor_health_start()) {
+        ESP_LOGE(TAG, "Failed to start sensor health monitor.");
     }
 
-    // Cấu hình GPIO
-    gpio_config_init();
     i2c_master_init();
     oled_init();
 
-    // Tạo Semaphore
-    button_semaphore = xSemaphoreCreateBinary();
-    if (button_semaphore == NULL) {
-        ESP_LOGE(TAG, "Failed to create semaphore.");
+    uploader = uploader_get();
+    punch_lock = sysmem_mutex_create();
+    if (punch_lock == NULL) {
+        ESP_LOGE(TAG, "Failed to create mutex.");
+        return;
+    }
+    load_pending_punches();
+
+    // Tạo Task chính
+    TaskHandle_t fingerprint_handle = sysmem_task_create(fingerprint_task, "Fingerprint Task",
+                                                         CONFIG_VANTAY_FINGERPRINT_TASK_STACK, NULL, 5);
+    if (fingerprint_handle == NULL) {
         return;
     }
-    time_queue = xQueueCreate(5, sizeof(char[64]));
-    if (time_queue == NULL) {
-        ESP_LOGE(TAG, "Failed to create queue.");
+    // Cấu hình GPIO nút nhấn / cảm biến chạm, sự kiện gửi tới fingerprint_task
+    if (!input_init(fingerprint_handle)) {
+        ESP_LOGE(TAG, "Failed to initialize input.");
         return;
     }
+    sysmem_task_create(time_sync_task, "time_sync_task", CONFIG_VANTAY_TIME_TASK_STACK, NULL, 4);
 
+    // Chấm công đã hoạt động, kết nối mạng và SNTP sau
     connect_wifi();
+    power_wifi_started();
     initialize_sntp();
-
-    // Tạo Task chính
-    xTaskCreate(fingerprint_task, "Fingerprint Task", 4096, NULL, 5, NULL);
-    xTaskCreate(time_sync_task, "time_sync_task", 4096, NULL, 4, NULL);
+#if CONFIG_VANTAY_MGMT_API
+    if (!mgmt_api_start(fingerprint_handle, templates_deleted)) {
+        ESP_LOGE(TAG, "Failed to start management API.");
+    }
+#endif
+    if (uploader->start(punch_result) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start %s uploader.", uploader->name);
+    }
+#if CONFIG_VANTAY_SOAK_TEST
+    if (!soak_start(&soak_target)) {
+        ESP_LOGE(TAG, "Failed to start soak test.");
+    }
+#endif
+    sysmem_report();
     ESP_LOGI(TAG, "Attendance system initialized.");
 }
@@ -0,0 +1,92 @@
+// Đo hiệu năng và kiểm tra các kernel đánh giá chất lượng ảnh vân tay trên máy tính.
+//
+// Biên dịch:  gcc -O2 -I../main -o fp_quality_bench fp_quality_bench.c ../main/fp_quality.c
+// Chạy:       ./fp_quality_bench [-n lần_lặp] [-p kích_thước_gói] ảnh1.raw ảnh2.raw ...
+//
+// Mỗi file .raw là dữ liệu ảnh ghép từ các gói UpImage (256x288, 4 bit/điểm, 36864 byte).
+// Ảnh được nạp theo từng gói như trên thiết bị để đo đúng đường xử lý tăng dần.
+//
+// Chưa có bộ ảnh ghi từ cảm biến thật trong repo, nên ngưỡng trong fp_quality.h chưa được
+// kiểm chứng trên dữ liệu thật. Lần chạy duy nhất đến nay chỉ là kiểm tra nhanh trên ảnh tổng
+// hợp (vân sin chu kỳ 9 điểm, -n 500 -p 128, gcc -O2, Xeon x86-64), không phải kết quả đánh giá:
+//   trắng trơn               cov 0    NO FINGER   ~295 us/ảnh
+//   vân đầy đủ               cov 100  OK          ~264 us/ảnh
+//   vân tương phản thấp      cov 0    NO FINGER   ~195 us/ảnh
+//   vân nửa trên             cov 50   OK          ~195 us/ảnh
+//   tối đều (vết bẩn)        cov 0    NO FINGER   ~214 us/ảnh
+// Ảnh vân tương phản thấp bị coi là không có ngón tay thay vì "PRESS HARDER": cần ảnh thật
+// để chỉnh lại ngưỡng độ phủ / độ tương phản.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "fp_quality.h"
+
+#define IMAGE_BYTES (FP_ROW_BYTES * FP_IMAGE_HEIGHT)
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int load_image(const char *path, uint8_t *image) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    size_t n = fread(image, 1, IMAGE_BYTES, f);
+    fclose(f);
+    if (n != IMAGE_BYTES) {
+        fprintf(stderr, "%s: expected %d bytes, got %zu\n", path, IMAGE_BYTES, n);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int iterations = 1000;
+    size_t packet = 128;
+    int first = 1;
+
+    while (first < argc && argv[first][0] == '-') {
+        if (strcmp(argv[first], "-n") == 0 && first + 1 < argc) {
+            iterations = atoi(argv[first + 1]);
+        } else if (strcmp(argv[first], "-p") == 0 && first + 1 < argc) {
+            packet = (size_t)atoi(argv[first + 1]);
+        } else {
+            break;
+        }
+        first += 2;
+    }
+    if (first >= argc || iterations <= 0 || packet == 0) {
+        fprintf(stderr, "usage: %s [-n iterations] [-p packet_size] image.raw...\n", argv[0]);
+        return 1;
+    }
+
+    static uint8_t image[IMAGE_BYTES];
+    fp_quality_t q;
+    fp_quality_result_t r;
+
+    printf("%-32s %4s %4s %5s %4s %4s %-13s %9s\n",
+           "image", "cov", "con", "clar", "cx", "cy", "hint", "us/image");
+    for (int i = first; i < argc; i++) {
+        if (load_image(argv[i], image) != 0) {
+            return 1;
+        }
+        double start = now_ns();
+        for (int it = 0; it < iterations; it++) {
+            fp_quality_begin(&q);
+            for (size_t off = 0; off < IMAGE_BYTES; off += packet) {
+                size_t n = IMAGE_BYTES - off < packet ? IMAGE_BYTES - off : packet;
+                fp_quality_feed(&q, image + off, n);
+            }
+            fp_quality_finish(&q, &r);
+        }
+        double us = (now_ns() - start) / iterations / 1000.0;
+        printf("%-32s %4d %4d %5d %4d %4d %-13s %9.1f\n", argv[i], r.coverage, r.contrast,
+               r.clarity, r.center_x, r.center_y, fp_quality_hint_str(r.hint), us);
+    }
+    return 0;
+}
@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+"""Tạo ảnh phân vùng danh bạ nhân viên (main/directory.h) từ file CSV.
+
+CSV có header: code,name,slots
+    NV001,Nguyễn Văn An,0;1
+    NV002,Trần Thị Bình,2
+
+"slots" là các vị trí vân tay (0-175) của nhân viên, cách nhau bởi ';'.
+Một nhân viên có thể có nhiều vân tay.
+
+Tạo và nạp (không cần nạp lại firmware):
+    python3 mkdirectory.py employees.csv directory.bin
+    parttool.py --port /dev/ttyUSB0 write_partition --partition-name directory --input directory.bin
+"""
+import argparse
+import csv
+import re
+import struct
+import sys
+import unicodedata
+import zlib
+
+MAGIC = b"VDIR"
+VERSION = 1
+SLOT_COUNT = 176
+NO_EMPLOYEE = 0xFFFF
+CODE_LEN = 12
+NAME_LEN = 20
+HEADER_FMT = "<4sHHHHII12s"
+PARTITION_SIZE = 0x10000
+CODE_RE = re.compile(r"[A-Za-z0-9_-]+")
+NAME_RE = re.compile(r"[A-Z0-9 ]+")  # Ký tự có trong font5x8 của OLED
+
+
+def display_name(name):
+    """Chữ in hoa không dấu, vì font OLED chỉ có A-Z và 0-9. Ký tự khác thì báo lỗi, không thay thế."""
+    shown = name.replace("đ", "d").replace("Đ", "D")
+    shown = unicodedata.normalize("NFD", shown)
+    shown = "".join(c for c in shown if not unicodedata.combining(c))
+    shown = " ".join(shown.upper().split())
+    if not NAME_RE.fullmatch(shown):
+        raise ValueError(f"invalid name {name!r} (only letters, digits and spaces can be shown on the OLED)")
+    if len(shown) > NAME_LEN - 1:
+        raise ValueError(f"name {name!r} too long (max {NAME_LEN - 1} chars)")
+    return shown
+
+
+def build(rows):
+    employees = sorted(rows, key=lambda r: r["code"])
+    slot_map = [NO_EMPLOYEE] * SLOT_COUNT
+    for index, emp in enumerate(employees):
+        for slot in emp["slots"]:
+            if not 0 <= slot < SLOT_COUNT:
+                raise ValueError(f"{emp['code']}: slot {slot} out of range")
+            if slot_map[slot] != NO_EMPLOYEE:
+                raise ValueError(f"slot {slot} assigned twice")
+            slot_map[slot] = index
+
+    data = struct.pack(f"<{SLOT_COUNT}H", *slot_map)
+    data += b"\0" * (-len(data) % 4)
+    for emp in employees:
+        data += emp["code"].encode("ascii").ljust(CODE_LEN, b"\0")
+        data += emp["name"].encode("ascii").ljust(NAME_LEN, b"\0")
+
+    header_size = struct.calcsize(HEADER_FMT)
+    header = struct.pack(HEADER_FMT, MAGIC, VERSION, SLOT_COUNT, len(employees),
+                         CODE_LEN + NAME_LEN, zlib.crc32(data), header_size + len(data), b"\0" * 12)
+    return header + data
+
+
+def read_csv(path):
+    rows = []
+    codes = set()
+    with open(path, newline="", encoding="utf-8") as f:
+        for line in csv.DictReader(f):
+            code = line["code"].strip()
+            if not CODE_RE.fullmatch(code) or len(code) > CODE_LEN:
+                raise ValueError(f"invalid code {code!r} (max {CODE_LEN} chars of A-Z a-z 0-9 _ -)")
+            if code in codes:
+                raise ValueError(f"duplicate code {code}")
+            codes.add(code)
+            slots = [int(s) for s in line["slots"].replace(",", ";").split(";") if s.strip()]
+            rows.append({"code": code, "name": display_name(line["name"]), "slots": slots})
+    return rows
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("csv")
+    ap.add_argument("output")
+    args = ap.parse_args()
+
+    try:
+        image = build(read_csv(args.csv))
+    except (ValueError, KeyError) as e:
+        print(f"error: {e}", file=sys.stderr)
+        return 1
+    if len(image) > PARTITION_SIZE:
+        print(f"error: image is {len(image)} bytes, partition holds {PARTITION_SIZE}", file=sys.stderr)
+        return 1
+    with open(args.output, "wb") as f:
+        f.write(image)
+    print(f"{args.output}: {len(image)} bytes", file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,222 @@
+#!/usr/bin/env python3
+"""Bộ nhận bản ghi chấm công nhị phân (định dạng trong main/record_codec.h).
+
+Chạy như máy nhận cục bộ:
+    python3 record_receiver.py --port 8080
+
+Hoặc làm shim chuyển tiếp sang Google Sheets (mỗi bản ghi một POST JSON như firmware cũ):
+    python3 record_receiver.py --port 8080 --forward https://script.google.com/macros/s/.../exec
+
+Giải mã một file đã ghi lại:
+    python3 record_receiver.py --decode payload.bin
+
+Thêm mã nhân viên ("Code") như firmware gửi ở chế độ JSON, từ cùng file CSV đã dùng để tạo
+phân vùng danh bạ (tools/mkdirectory.py):
+    python3 record_receiver.py --port 8080 --directory employees.csv
+"""
+import argparse
+import json
+import sys
+import time
+import urllib.request
+from collections import OrderedDict
+from http.server import BaseHTTPRequestHandler, HTTPServer
+
+import mkdirectory
+
+RECORD_FORMAT_V1 = 0xA1  # Firmware cũ, không có seq
+RECORD_FORMAT_V2 = 0xA3
+SUMMARY_FORMAT_V1 = 0xA2
+UTC_OFFSET_S = 7 * 3600  # Giờ Việt Nam, giống TZ trên thiết bị
+FORWARDED_MEMORY = 4096  # Số dòng đã chuyển tiếp được nhớ để bỏ trùng khi thiết bị gửi lại
+
+
+def read_varint(buf, pos):
+    value = 0
+    shift = 0
+    while True:
+        if pos >= len(buf):
+            raise ValueError("truncated varint")
+        b = buf[pos]
+        pos += 1
+        value |= (b & 0x7F) << shift
+        if b < 0x80:
+            return value, pos
+        shift += 7
+        if shift > 35:
+            raise ValueError("varint too long")
+
+
+def unzigzag(v):
+    return (v >> 1) ^ -(v & 1)
+
+
+def decode(payload):
+    """Trả về (device_id, [ {slot, seq, epoch, uncertainty_ms}, ... ]); seq là None với gói 0xA1."""
+    if not payload or payload[0] not in (RECORD_FORMAT_V1, RECORD_FORMAT_V2):
+        raise ValueError("unknown format byte")
+    has_seq = payload[0] == RECORD_FORMAT_V2
+    pos = 1
+    device_id, pos = read_varint(payload, pos)
+    epoch, pos = read_varint(payload, pos)
+    seq = None
+    if has_seq:
+        seq, pos = read_varint(payload, pos)
+    records = []
+    while pos < len(payload):
+        slot, pos = read_varint(payload, pos)
+        delta, pos = read_varint(payload, pos)
+        unc, pos = read_varint(payload, pos)
+        epoch += unzigzag(delta)
+        if has_seq:
+            delta, pos = read_varint(payload, pos)
+            seq = (seq + unzigzag(delta)) & 0xFFFFFFFF
+        records.append({
+            "slot": slot,
+            "seq": seq,
+            "epoch": epoch,
+            "uncertainty_ms": None if unc == 0 else unc - 1,
+        })
+    return device_id, records
+
+
+def decode_summary(payload):
+    """Trả về (device_id, day YYYYMMDD, [ {slot, first_min, last_min, total_min}, ... ])."""
+    if not payload or payload[0] != SUMMARY_FORMAT_V1:
+        raise ValueError("unknown format byte")
+    pos = 1
+    device_id, pos = read_varint(payload, pos)
+    day, pos = read_varint(payload, pos)
+    rows = []
+    while pos < len(payload):
+        row = {}
+        for key in ("slot", "first_min", "last_min", "total_min"):
+            row[key], pos = read_varint(payload, pos)
+        rows.append(row)
+    return device_id, day, rows
+
+
+def summary_to_sheet_json(day, rows):
+    """Cùng dạng JSON firmware gửi Google Sheets ở chế độ tổng hợp."""
+    return {
+        "Day": f"{day // 10000:04d}-{day // 100 % 100:02d}-{day % 100:02d}",
+        "Rows": [[r["slot"], r["first_min"], r["last_min"], r["total_min"]] for r in rows],
+    }
+
+
+def load_codes(path):
+    """Vị trí vân tay -> mã nhân viên, đọc CSV danh bạ giống tools/mkdirectory.py."""
+    codes = {}
+    for row in mkdirectory.read_csv(path):
+        for slot in row["slots"]:
+            codes[slot] = row["code"]
+    return codes
+
+
+def decode_any(payload, codes=None):
+    """Danh sách (device_id, JSON cho Google Sheets) của một gói bất kỳ."""
+    if payload and payload[0] == SUMMARY_FORMAT_V1:
+        device_id, day, rows = decode_summary(payload)
+        return [(device_id, summary_to_sheet_json(day, rows))]
+    device_id, records = decode(payload)
+    return [(device_id, to_sheet_json(r, codes)) for r in records]
+
+
+def to_sheet_json(record, codes=None):
+    """Bản ghi theo đúng dạng JSON firmware gửi Google Sheets. Code rỗng nếu không có danh bạ."""
+    local = time.gmtime(record["epoch"] + UTC_OFFSET_S)
+    unc = record["uncertainty_ms"]
+    row = {
+        "ID": str(record["slot"]),
+        "Code": (codes or {}).get(record["slot"], ""),
+        "Time": time.strftime("%Y-%m-%d %H:%M:%S", local),
+        "Uncertainty": str(-1 if unc is None else unc),
+    }
+    if record["seq"] is not None:
+        row["Seq"] = str(record["seq"])
+    return row
+
+
+def dedupe_key(device_id, row):
+    """Khóa bỏ trùng của một dòng.
+
+    Bản ghi chấm công gửi lại được đóng dấu lại (Time, Uncertainty đổi sau khi SNTP đồng bộ),
+    nên khóa theo seq mà thiết bị cấp lúc chấm công. Gói 0xA1 cũ không có seq thì dùng cả dòng.
+    """
+    if "Seq" in row:
+        return json.dumps([device_id, row["ID"], row["Seq"]])
+    return json.dumps([device_id, row], sort_keys=True)
+
+
+def make_handler(forward_url, codes=None):
+    # Dòng đã chuyển tiếp thành công. Chuyển tiếp lỗi thì trả 502 để thiết bị giữ lại cả lô và
+    # gửi lại; các dòng của lô đó đã tới Google Sheets được bỏ qua ở lần sau, không ghi trùng.
+    forwarded = OrderedDict()
+
+    class Handler(BaseHTTPRequestHandler):
+        def do_POST(self):
+            length = int(self.headers.get("Content-Length", 0))
+            payload = self.rfile.read(length)
+            try:
+                rows = decode_any(payload, codes)
+            except ValueError as e:
+                self.send_error(400, str(e))
+                return
+            for device_id, row in rows:
+                print(json.dumps({"device": device_id, **row}), flush=True)
+                if not forward_url:
+                    continue
+                key = dedupe_key(device_id, row)
+                if key in forwarded:
+                    continue
+                req = urllib.request.Request(
+                    forward_url, data=json.dumps(row).encode(),
+                    headers={"Content-Type": "application/json"}, method="POST")
+                try:
+                    urllib.request.urlopen(req, timeout=30).read()
+                except OSError as e:
+                    print(f"forward failed: {e}", file=sys.stderr)
+                    self.send_error(502, "forward failed")
+                    return
+                forwarded[key] = True
+                if len(forwarded) > FORWARDED_MEMORY:
+                    forwarded.popitem(last=False)
+            self.send_response(204)
+            self.end_headers()
+
+        def log_message(self, fmt, *args):
+            pass
+
+    return Handler
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--port", type=int, default=8080)
+    ap.add_argument("--forward", help="Google Sheets script URL to forward decoded rows to")
+    ap.add_argument("--decode", help="decode a captured payload file and exit")
+    ap.add_argument("--directory", help="employee CSV (as for mkdirectory.py) to fill in the Code field")
+    args = ap.parse_args()
+
+    codes = None
+    if args.directory:
+        try:
+            codes = load_codes(args.directory)
+        except (OSError, ValueError, KeyError) as e:
+            print(f"error: {e}", file=sys.stderr)
+            return 1
+
+    if args.decode:
+        with open(args.decode, "rb") as f:
+            rows = decode_any(f.read(), codes)
+        for device_id, row in rows:
+            print(json.dumps({"device": device_id, **row}))
+        return
+
+    server = HTTPServer(("0.0.0.0", args.port), make_handler(args.forward, codes))
+    print(f"listening on :{args.port}", file=sys.stderr)
+    server.serve_forever()
+
+
+if __name__ == "__main__":
+    sys.exit(main())